@@ -33,7 +33,7 @@ static const msg_handler_entry_t _be_test = { MSG_BE_TEST, _handle_be_test };
 static const msg_handler_entry_t _cmt_sm_tick_handler_entry = { MSG_CMT_SLEEP, _handle_cmt_sleep };
 static const msg_handler_entry_t _ui_initialized_handler_entry = { MSG_UI_INITIALIZED, _handle_ui_initialized };
 
-// For performance - put these in order that we expect to receive more often
+// The loop dispatches by message ID, so order only matters for multiple handlers of a message
 static const msg_handler_entry_t* _be_handler_entries[] = {
     & _cmt_sm_tick_handler_entry,
     & _ui_initialized_handler_entry,
@@ -41,23 +41,25 @@ static const msg_handler_entry_t* _be_handler_entries[] = {
     ((msg_handler_entry_t*)0), // Last entry must be a NULL
 };
 
-static const idle_fn _be_idle_functions[] = {
-    // Cast needed do to definition needed to avoid circular reference.
-    (idle_fn)_be_idle_function_1,
-    (idle_fn)0, // Last entry must be a NULL
+// The option switches are only changed by hand, so reading them 50 times a second is plenty.
+static const idle_task_entry_t _be_options_read_task = { _be_idle_function_1, (20 * 1000), 50 };
+
+static const idle_task_entry_t* _be_idle_tasks[] = {
+    & _be_options_read_task,
+    ((idle_task_entry_t*)0), // Last entry must be a NULL
 };
 
 msg_loop_cntx_t be_msg_loop_cntx = {
     BE_CORE_NUM, // Back-end runs on Core 0
     _be_handler_entries,
-    _be_idle_functions,
+    _be_idle_tasks,
 };
 
 // ====================================================================
 // Idle functions
 //
 // Something to do when there are no messages to process.
-// (These are cycled through, so do one task.)
+// (Each runs when its task is due, so do one task, within the budget.)
 // ====================================================================
 
 static void _be_idle_function_1() {
@@ -70,26 +72,31 @@ static void _be_idle_function_1() {
 // ====================================================================
 
 static void _handle_be_test(cmt_msg_t* msg) {
-    // Test `scheduled_msg_ms` error
-    static int times = 1;
-    static cmt_msg_t msg_time = { MSG_BE_TEST };
+    // Test `schedule_msg_every_ms` error
+    static cmt_sm_handle_t test_handle = CMT_SM_HANDLE_INVALID;
+    static int times = 0;
     static uint64_t first_t = 0;
+    static uint64_t last_t = 0;
 
     uint64_t period = 60;
-
+    uint64_t now = now_us();
+
+    if (CMT_SM_HANDLE_INVALID == test_handle) {
+        // First time - start the repeating test message
+        cmt_msg_t msg_time = { MSG_BE_TEST };
+        test_handle = schedule_msg_every_ms((period * 1000), &msg_time);
+        first_t = now;
+        last_t = now;
+        return;
+    }
+    times++;
     if (debug_enabled()) {
-        uint64_t now = now_us();
-        if (first_t == 0) { first_t = now; }
-
-        uint64_t last_time = msg->data.ts_us;
-        int64_t error = ((now - last_time) - (period * 1000 * 1000));
+        int64_t error = ((now - last_t) - (period * 1000 * 1000));
         int64_t total_error = (now - (first_t + (times * (period * 1000 * 1000))));
         float error_per_ms = ((error * 1.0) / (period * 1000.0));
-        info_printf("\n%5d - Error us/ms:%5.2f  Avg:%5d\n", times, error_per_ms, (total_error / (times * period)));
+        info_printf("\n%5d - Error us/ms:%5.2f  Avg:%5d  Missed:%d\n", times, error_per_ms, (total_error / (times * period)), scheduled_msg_handle_missed(test_handle));
     }
-    msg_time.data.ts_us = now_us(); // Get the 'next' -> 'last_time' fresh
-    schedule_msg_in_ms((period * 1000), &msg_time);
-    times++;
+    last_t = now;
 }
 
 static void _handle_cmt_sleep(cmt_msg_t* msg) {
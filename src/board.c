@@ -32,9 +32,11 @@
 #include "system_defs.h"
 
 #include "board.h"
+#include "cmt_co.h"
 #include "debug.h"
 #include "display.h"
 #include "multicore.h"
+#include "spi_ops.h"
 #include "util.h"
 
 const uint LED_PIN = PICO_DEFAULT_LED_PIN;
@@ -97,6 +99,8 @@ int board_init() {
     gpio_put(SPI_DC_DISPLAY, DISPLAY_DC_DATA);
     gpio_put(SPI_CS_SDCARD, SPI_CS_DISABLE);
     gpio_put(SPI_CS_TOUCH, SPI_CS_DISABLE);
+    // DMA for the SPI writes (its interrupt is handled on this core)
+    spi_ops_module_init();
 
     // NOT USING I2C AT THIS TIME.
     //
@@ -178,41 +182,90 @@ void boot_to_bootsel() {
     reset_usb_boot(0, 0);
 }
 
+/**
+ * @brief Start a pattern coroutine on core 0.
+ *
+ * The patterns always run on core 0, so that a new pattern can replace one that is still
+ * running whichever core asks for it. From core 1 a message is scheduled for core 0 to start it.
+ *
+ * @param start_fn Function (run on core 0) that starts the coroutine with the pattern.
+ * @param pattern The pattern.
+ * @return true if it was started (or will be), false if it can't be (core 0's message loop
+ *      isn't running, or no scheduled message is available).
+ */
+static bool _pattern_co_start(cmt_sleep_fn start_fn, const int32_t* pattern) {
+    if (!cmt_message_loop_0_running()) {
+        return (false);
+    }
+    if (0 == get_core_num()) {
+        start_fn((void*)pattern);
+        return (true);
+    }
+    cmt_msg_t msg = { MSG_CMT_SLEEP, CMT_MSG_PRIO_URGENT };
+    msg.data.cmt_sleep.sleep_fn = start_fn;
+    msg.data.cmt_sleep.user_data = (void*)pattern;
+    return (CMT_SM_HANDLE_INVALID != schedule_core_msg_in_us(CMT_SM_CORE0, 0, &msg));
+}
+
 static void _tone_sound_pattern_cont(void *user_data) {
     tone_on(false);
 }
 void tone_sound_pattern(int ms) {
     tone_on(true);
-    if (!cmt_message_loop_0_running()) {
+    if (!cmt_message_loop_0_running()
+        || CMT_SM_HANDLE_INVALID == cmt_sleep_ms(ms, _tone_sound_pattern_cont, NULL)) {
+        // Message system isn't running, or no scheduled message is available. Just wait.
         sleep_ms(ms);
         _tone_sound_pattern_cont(NULL);
     }
-    else {
-        cmt_sleep_ms(ms, _tone_sound_pattern_cont, NULL);
-    }
 }
 
 void tone_on(bool on) {
     gpio_put(TONE_DRIVE, (on ? TONE_ON : TONE_OFF));
 }
 
-void _tone_on_off_cont(void* data) {
-    int32_t *pattern = (int32_t*)data;
-    tone_on_off(pattern);
+static cmt_co_t _tone_on_off_co;
+static const int32_t* _tone_pattern;
+
+static cmt_co_result_t _tone_on_off_run(cmt_co_t* co) {
+    CMT_CO_BEGIN(co);
+    while (*_tone_pattern) {
+        tone_on(true);
+        CMT_CO_AWAIT_SLEEP(co, *_tone_pattern++);
+        tone_on(false);
+        if (0 == *_tone_pattern) {
+            CMT_CO_EXIT(co);
+        }
+        CMT_CO_AWAIT_SLEEP(co, *_tone_pattern++);
+    }
+    CMT_CO_END(co);
 }
+
+static void _tone_on_off_start(void* user_data) {
+    // A new pattern replaces one that is still sounding (which can be in an 'on' step)
+    tone_on(false);
+    _tone_pattern = (const int32_t*)user_data;
+    if (_tone_pattern && *_tone_pattern) {
+        cmt_co_start(&_tone_on_off_co, _tone_on_off_run, NULL);
+    }
+    else {
+        cmt_co_stop(&_tone_on_off_co);
+    }
+}
+
 void tone_on_off(const int32_t *pattern) {
-    while (*pattern) {
-        tone_sound_pattern(*pattern++);
-        int off_time = *pattern++;
-        if (off_time == 0) {
-            return;
-        }
-        if (!cmt_message_loop_0_running()) {
+    if (!_pattern_co_start(_tone_on_off_start, pattern)) {
+        // Message system isn't running (or is out of scheduled messages). Just wait.
+        while (pattern && *pattern) {
+            tone_on(true);
+            sleep_ms(*pattern++);
+            tone_on(false);
+            int off_time = *pattern++;
+            if (off_time == 0) {
+                return;
+            }
             sleep_ms(off_time);
         }
-        else {
-            cmt_sleep_ms(off_time, _tone_on_off_cont, (void*)pattern);
-        }
     }
 }
 
@@ -239,36 +292,60 @@ static void _led_flash_cont(void* user_data) {
 }
 void led_flash(int ms) {
     led_on(true);
-    if (!cmt_message_loop_0_running()) {
+    if (!cmt_message_loop_0_running()
+        || CMT_SM_HANDLE_INVALID == cmt_sleep_ms(ms, _led_flash_cont, NULL)) {
+        // Message system isn't running, or no scheduled message is available. Just wait.
         sleep_ms(ms);
         _led_flash_cont(NULL);
     }
-    else {
-        cmt_sleep_ms(ms, _led_flash_cont, NULL);
-    }
 }
 
 void led_on(bool on) {
     gpio_put(LED_PIN, on);
 }
 
-void _led_on_off_cont(void* user_data) {
-    int32_t* pattern = (int32_t*)user_data;
-    led_on_off(pattern);
+static cmt_co_t _led_on_off_co;
+static const int32_t* _led_pattern;
+
+static cmt_co_result_t _led_on_off_run(cmt_co_t* co) {
+    CMT_CO_BEGIN(co);
+    while (*_led_pattern) {
+        led_on(true);
+        CMT_CO_AWAIT_SLEEP(co, *_led_pattern++);
+        led_on(false);
+        if (0 == *_led_pattern) {
+            CMT_CO_EXIT(co);
+        }
+        CMT_CO_AWAIT_SLEEP(co, *_led_pattern++);
+    }
+    CMT_CO_END(co);
+}
+
+static void _led_on_off_start(void* user_data) {
+    // A new pattern replaces one that is still showing (which can be in an 'on' step)
+    led_on(false);
+    _led_pattern = (const int32_t*)user_data;
+    if (_led_pattern && *_led_pattern) {
+        cmt_co_start(&_led_on_off_co, _led_on_off_run, NULL);
+    }
+    else {
+        cmt_co_stop(&_led_on_off_co);
+    }
 }
+
 void led_on_off(const int32_t *pattern) {
-    while (*pattern) {
-        led_flash(*pattern++);
-        int off_time = *pattern++;
-        if (off_time == 0) {
-            return;
-        }
-        if (!cmt_message_loop_0_running()) {
+    if (!_pattern_co_start(_led_on_off_start, pattern)) {
+        // Message system isn't running (or is out of scheduled messages). Just wait.
+        while (pattern && *pattern) {
+            led_on(true);
+            sleep_ms(*pattern++);
+            led_on(false);
+            int off_time = *pattern++;
+            if (off_time == 0) {
+                return;
+            }
             sleep_ms(off_time);
         }
-        else {
-            cmt_sleep_ms(off_time, _led_on_off_cont, (void*)pattern);
-        }
     }
 }
 
@@ -56,6 +56,9 @@ void tone_on(bool on);
  * @ingroup board
  *
  * This beeps the buzzer for times specified by the `pattern` in milliseconds.
+ * The pattern runs in core 0's message loop (it can be started from either core), and a new
+ * pattern replaces one that is still running. An empty (or NULL) pattern stops one that is
+ * running.
  *
  * @param pattern Array of millisend values to beep the buzzer on, off, on, etc.
  *      The last element of the array must be 0.
@@ -99,6 +102,9 @@ void led_on(bool on);
  * @ingroup board
  *
  * This flashes the LED for times specified by the `pattern` in milliseconds.
+ * The pattern runs in core 0's message loop (it can be started from either core), and a new
+ * pattern replaces one that is still running. An empty (or NULL) pattern stops one that is
+ * running.
  *
  * @param pattern Array of millisend values to turn the LED on, off, on, etc.
  *      The last element of the array must be 0.
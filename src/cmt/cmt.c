@@ -8,36 +8,87 @@
  *
 */
 #include "cmt.h"
+#include "cmt_co.h"
+#include "cmt_trace.h"
+#include "msg_payload.h"
 #include "system_defs.h"
 #include "board.h"
 #include "debug.h"
 #include "util.h"
 #include "hardware/structs/nvic.h"
-#include "pico/mutex.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "pico/stdlib.h"
 #include "pico/time.h"
 #include <stdlib.h>
 #include <string.h>
 
 
-#define _SCHEDULED_MESSAGES_MAX 16
-#define _SM_OVERHEAD_US_PER_MS 35 // From testing (@SEE be._handle_be_test)
-#define _SMD_FREE_INDICATOR (-1)
+#define _SM_ID_BUCKETS 16               // Number of ID index buckets (must be a power of 2)
+#define _SM_DUE_BATCH 8                 // Max messages posted (per lock) by the alarm handler
+#define _SM_NONE (-1)                   // 'null' pool index
 
-typedef bool (*get_msg_nowait_fn)(cmt_msg_t* msg);
+#ifndef CMT_DISPATCH_HANDLERS_MAX
+#define CMT_DISPATCH_HANDLERS_MAX 32    // Max handler entries per message loop (must be < 256)
+#endif
 
+#ifndef CMT_MSG_BATCH_MAX
+#define CMT_MSG_BATCH_MAX 8             // Max messages a message loop takes from its queue at once
+#endif
+
+#ifndef CMT_IDLE_TASKS_MAX
+#define CMT_IDLE_TASKS_MAX 16           // Max idle tasks per message loop
+#endif
+
+#ifndef CMT_MSG_STATS
+#define CMT_MSG_STATS 1                 // Keep queue/handler time statistics for each message ID (0 = don't)
+#endif
+
+#ifndef CMT_IDLE_SLEEP_MAX_US
+#define CMT_IDLE_SLEEP_MAX_US 10000     // Max time an idle loop sleeps (WFE) waiting for a task to be due (0 = don't sleep)
+#endif
+
+typedef uint16_t (*get_msgs_nowait_fn)(cmt_msg_t* msgs, uint16_t max);
+
+/**
+ * @brief Scheduled message pool entry.
+ *
+ * Entries are either on the free list or on the pending list (ordered by deadline).
+ * Pending entries are also on an ID index chain so the ID based calls don't have to
+ * look at every entry. A repeating entry stays pending (with the same handle) until
+ * it is cancelled.
+ *
+ * A one-shot entry holds a reserved slot in the scheduled message ring of each core it is
+ * for (from when it is scheduled until it is posted or cancelled), so the alarm interrupt
+ * can always post it. Repeating entries use the slots that aren't reserved, and count a
+ * period as missed if there isn't one.
+ */
 typedef struct _scheduled_msg_data_ {
-    int32_t remaining;
-    uint8_t corenum;
-    int32_t ms_requested;
-    cmt_msg_t* client_msg;
-    cmt_msg_t sleep_msg;
+    uint16_t gen;                       // Generation - incremented on free to invalidate old handles
+    bool active;
+    uint8_t cores;                      // Core(s) to post to (CMT_SM_CORE0 and/or CMT_SM_CORE1)
+    int16_t next;                       // Next entry (pending list or free list)
+    int16_t prev;                       // Previous entry (pending list)
+    int16_t id_next;                    // Next entry in the ID index chain
+    int16_t id_prev;                    // Previous entry in the ID index chain
+    uint64_t deadline;                  // Absolute time (`time_us_64`) the message is to be posted
+    uint64_t period;                    // Period in microseconds for a repeating message (0 = one-shot)
+    uint32_t missed;                    // Periods missed (skipped, or no free slot for a target core)
+    cmt_msg_t msg;                      // Copy of the message to post
 } _scheduled_msg_data_t;
 
 
-auto_init_mutex(sm_mutex);
-static _scheduled_msg_data_t _scheduled_message_datas[_SCHEDULED_MESSAGES_MAX]; // Objects to use (no malloc/free)
-static repeating_timer_t _schd_msg_timer_data;
+static spin_lock_t* _sm_lock;
+static uint _sm_alarm_num;
+static _scheduled_msg_data_t _scheduled_message_datas[CMT_SCHEDULED_MESSAGES_MAX]; // Objects to use (no malloc/free)
+static int16_t _sm_free;                            // Head of the free list
+static int16_t _sm_head;                            // Earliest deadline pending entry
+static int16_t _sm_tail;                            // Latest deadline pending entry
+static int16_t _sm_id_index[_SM_ID_BUCKETS];        // ID index chain heads
+static int _sm_pending;                             // Number of pending entries
+static uint16_t _sm_reserved[2];                    // Scheduled ring slots reserved by one-shot entries, for each core
+static volatile uint32_t _sm_missed[2];             // Repeating message posts missed (no free slot), for each core
+static uint32_t _sm_missed_reported[2];             // (the count at the last report)
 
 static bool _msg_loop_0_running = false;
 static bool _msg_loop_1_running = false;
@@ -46,45 +97,538 @@ static proc_status_accum_t _psa[2]; // One Proc Status Accumulator for each core
 static proc_status_accum_t _psa_sec[2]; // Proc Status Accumulator per second for each core
 
 /**
- * @brief Repeating alarm callback handler.
- * Handles the from the repeating timer, adjusts the time left and posts a message to
- * the appropriate core when time hits 0.
+ * @brief Calls and time (us) of a message handler or idle task.
+ */
+typedef struct _fn_accum_ {
+    uint32_t calls;
+    uint32_t t_us;
+    uint32_t overruns;                  // Idle task runs over budget
+} _fn_accum_t;
+
+/**
+ * @brief Run state of an idle task.
+ */
+typedef struct _idle_task_state_ {
+    uint32_t last_run;                  // Time (us) the last run started
+    bool ran;                           // Has run in this idle pass
+} _idle_task_state_t;
+
+static _fn_accum_t _handler_accum[2][CMT_DISPATCH_HANDLERS_MAX];   // Per dispatch table entry, for each core
+static _fn_accum_t _handler_sec[2][CMT_DISPATCH_HANDLERS_MAX];     // (per second)
+static _fn_accum_t _idle_accum[2][CMT_IDLE_TASKS_MAX];             // Per idle task, for each core
+static _fn_accum_t _idle_sec[2][CMT_IDLE_TASKS_MAX];               // (per second)
+static _idle_task_state_t _idle_state[2][CMT_IDLE_TASKS_MAX];
+static const idle_task_entry_t** _idle_tasks[2];                   // Each core's idle task list
+static int _idle_task_cnt[2];
+static volatile uint32_t _idle_budget_start[2];                    // Start (us) of the running idle task
+static volatile uint32_t _idle_budget_us[2];                       // Budget of the running idle task (0 = none)
+static volatile uint32_t _psa_seq[2];                              // Odd while a core publishes its per second values
+
+/**
+ * @brief Message dispatch table for a message loop.
  *
- * @see repeating_timer_callback_t
+ * The handlers are grouped by message. The handlers for the message with dense index `i`
+ * are `handlers[first[i]]` through `handlers[first[i + 1] - 1]`.
+ */
+typedef struct _msg_dispatch_ {
+    uint8_t first[CMT_MSG_ID_CNT + 1];
+    msg_handler_fn handlers[CMT_DISPATCH_HANDLERS_MAX];
+} _msg_dispatch_t;
+
+static _msg_dispatch_t _dispatch[2]; // One dispatch table for each core's message loop
+static _msg_dispatch_t _shared_dispatch; // Dispatch table for the shared work queue (either core)
+static _fn_accum_t _shared_accum[2][CMT_DISPATCH_HANDLERS_MAX];    // Per shared dispatch table entry, for each core
+static _fn_accum_t _shared_sec[2][CMT_DISPATCH_HANDLERS_MAX];      // (per second)
+// Time spent in `cmt_shared_help` (already charged to the shared work), for each core, that
+// hasn't yet been left out of the time of the code that called it.
+static uint32_t _shared_helped_us[2];
+
+// The number of IDs in each message ID block.
+static const uint16_t _msg_block_cnt[] = { CMT_MSG_COMMON_CNT, CMT_MSG_BACKEND_CNT, CMT_MSG_UI_CNT };
+
+/**
+ * @brief Build the dispatch table for a message loop from its handler entries.
  *
- * \param rt repeating time structure containing information about the repeating time. (not used)
- * \return true to continue repeating, false to stop.
+ * @param dt The dispatch table to fill in.
+ * @param handler_entries NULL terminated list of message handler entries.
  */
-bool _schd_msg_timer_callback(repeating_timer_t* rt) {
-    for (int i = 0; i < _SCHEDULED_MESSAGES_MAX; i++) {
-        _scheduled_msg_data_t* smd = &_scheduled_message_datas[i];
-        if (smd->remaining > 0) {
-            if (0 == --smd->remaining) {
-                if (0 == smd->corenum) {
-                    post_to_core0_blocking(smd->client_msg);
-                }
-                else {
-                    post_to_core1_blocking(smd->client_msg);
+static void _dispatch_build(_msg_dispatch_t* dt, const msg_handler_entry_t** handler_entries) {
+    uint8_t count[CMT_MSG_ID_CNT];
+    memset(count, 0, sizeof(count));
+    int total = 0;
+    for (const msg_handler_entry_t** hep = handler_entries; *hep; hep++) {
+        int index = cmt_msg_id_index((*hep)->msg_id);
+        if (index < 0) {
+            warn_printf("CMT - Handler for unknown message ID %#04.4x ignored.\n", (*hep)->msg_id);
+            continue;
+        }
+        if (total >= CMT_DISPATCH_HANDLERS_MAX) {
+            panic("CMT - Too many message handler entries (max: %d).", CMT_DISPATCH_HANDLERS_MAX);
+        }
+        count[index]++;
+        total++;
+    }
+    // Start of each message's handlers, then fill them in (keeping list order)
+    dt->first[0] = 0;
+    for (int i = 0; i < CMT_MSG_ID_CNT; i++) {
+        dt->first[i + 1] = dt->first[i] + count[i];
+        count[i] = dt->first[i];
+    }
+    for (const msg_handler_entry_t** hep = handler_entries; *hep; hep++) {
+        int index = cmt_msg_id_index((*hep)->msg_id);
+        if (index >= 0) {
+            dt->handlers[count[index]++] = (*hep)->msg_handler;
+        }
+    }
+}
+
+#if CMT_MSG_STATS
+static cmt_msg_stats_t _msg_stats[2][CMT_MSG_ID_CNT];  // Statistics for each message ID, for each core
+static volatile uint32_t _msg_stats_seq[2];         // Odd while a core is updating its statistics
+static volatile bool _msg_stats_reset_req[2];       // Reset requested (done by the core's message loop)
+
+static inline uint _msg_hist_bucket(uint32_t us) {
+    if (us == 0) {
+        return (0);
+    }
+    uint b = 32 - __builtin_clz(us);
+    return (b < CMT_MSG_HIST_BUCKETS ? b : CMT_MSG_HIST_BUCKETS - 1);
+}
+
+/**
+ * @brief Record the queue time and handler time of a message.
+ *
+ * Only called by the core's own message loop. The sequence number lets the
+ * other core take a consistent copy without a lock.
+ */
+static void _msg_stats_record(uint8_t corenum, int index, uint32_t queue_us, uint32_t handler_us) {
+    cmt_msg_stats_t* stats = &_msg_stats[corenum][index];
+    _msg_stats_seq[corenum]++;
+    __dmb();
+    stats->count++;
+    stats->queue_hist[_msg_hist_bucket(queue_us)]++;
+    stats->handler_hist[_msg_hist_bucket(handler_us)]++;
+    if (queue_us > stats->queue_max_us) {
+        stats->queue_max_us = queue_us;
+    }
+    if (handler_us > stats->handler_max_us) {
+        stats->handler_max_us = handler_us;
+    }
+    __dmb();
+    _msg_stats_seq[corenum]++;
+}
+
+static void _msg_stats_clear(uint8_t corenum) {
+    _msg_stats_seq[corenum]++;
+    __dmb();
+    memset(_msg_stats[corenum], 0, sizeof(_msg_stats[corenum]));
+    __dmb();
+    _msg_stats_seq[corenum]++;
+    _msg_stats_reset_req[corenum] = false;
+}
+
+static void _msg_hist_print(const char* label, const uint32_t* hist) {
+    printf("%s", label);
+    for (uint b = 0; b < CMT_MSG_HIST_BUCKETS; b++) {
+        if (hist[b]) {
+            unsigned long lo = (b == 0 ? 0 : 1ul << (b - 1));
+            if (b == CMT_MSG_HIST_BUCKETS - 1) {
+                printf(" %lu+us:%lu", lo, (unsigned long)hist[b]);
+            }
+            else {
+                printf(" %lu-%luus:%lu", lo, (1ul << b) - 1, (unsigned long)hist[b]);
+            }
+        }
+    }
+    printf("\n");
+}
+#endif
+
+/**
+ * @brief Get the message ID for a dense ID index (the reverse of `cmt_msg_id_index`).
+ */
+static int _msg_id_of_index(int index) {
+    for (uint block = 0; block < count_of(_msg_block_cnt); block++) {
+        if (index < _msg_block_cnt[block]) {
+            return ((int)((block << 8) | index));
+        }
+        index -= _msg_block_cnt[block];
+    }
+    return (-1);
+}
+
+/**
+ * @brief Publish a core's process status (and handler/idle task use) for the last second
+ *        and reset its accumulators.
+ *
+ * Only called by the core's own message loop. The values are written under a sequence lock,
+ * so the other core (`_psa_read`) gets a consistent copy.
+ */
+static void _psa_publish(uint8_t corenum, uint32_t now) {
+    proc_status_accum_t* psa = &_psa[corenum];
+    proc_status_accum_t* psa_sec = &_psa_sec[corenum];
+    float core_temp = onboard_temp_c(); // (read before the values are locked, it takes a while)
+    _psa_seq[corenum]++;
+    __dmb();
+    psa_sec->idle = psa->idle;
+    psa_sec->retrived = psa->retrived;
+    psa_sec->t_active = psa->t_active;
+    psa_sec->t_idle = psa->t_idle;
+    psa_sec->t_msgr = psa->t_msgr;
+    psa_sec->t_sleep = psa->t_sleep;
+    psa_sec->int_status = nvic_hw->iser;
+    psa_sec->core_temp = core_temp;
+    psa_sec->ts_psa = now;
+    memcpy(_handler_sec[corenum], _handler_accum[corenum], sizeof(_handler_sec[corenum]));
+    memcpy(_idle_sec[corenum], _idle_accum[corenum], sizeof(_idle_sec[corenum]));
+    memcpy(_shared_sec[corenum], _shared_accum[corenum], sizeof(_shared_sec[corenum]));
+    __dmb();
+    _psa_seq[corenum]++;
+    memset((void*)psa, 0, sizeof(proc_status_accum_t));
+    psa->ts_psa = now;
+    memset(_handler_accum[corenum], 0, sizeof(_handler_accum[corenum]));
+    memset(_idle_accum[corenum], 0, sizeof(_idle_accum[corenum]));
+    memset(_shared_accum[corenum], 0, sizeof(_shared_accum[corenum]));
+}
+
+/**
+ * @brief Copy published (per second) values for a core, retrying if they are being updated.
+ */
+static void _psa_read(uint8_t corenum, void* dest, const void* src, size_t size) {
+    uint32_t seq;
+    do {
+        seq = _psa_seq[corenum];
+        __dmb();
+        memcpy(dest, src, size);
+        __dmb();
+    } while ((seq & 1) || seq != _psa_seq[corenum]);
+}
+
+static inline int _sm_id_bucket(msg_id_t id) {
+    return ((id ^ (id >> 8)) & (_SM_ID_BUCKETS - 1));
+}
+
+static inline cmt_sm_handle_t _sm_handle(int16_t index) {
+    return (((cmt_sm_handle_t)_scheduled_message_datas[index].gen << 16) | (cmt_sm_handle_t)(index + 1));
+}
+
+/**
+ * @brief Get the pool index for a handle.
+ *
+ * Must be called with `_sm_lock` held.
+ *
+ * @return The index of the (still pending) entry, or _SM_NONE if the handle is stale or invalid.
+ */
+static int16_t _sm_index(cmt_sm_handle_t handle) {
+    int index = (int)(handle & 0xFFFF) - 1;
+    if (index < 0 || index >= CMT_SCHEDULED_MESSAGES_MAX) {
+        return (_SM_NONE);
+    }
+    _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+    if (!smd->active || smd->gen != (uint16_t)(handle >> 16)) {
+        return (_SM_NONE);
+    }
+    return ((int16_t)index);
+}
+
+/**
+ * @brief Insert an entry into the pending list (by deadline).
+ *
+ * New entries usually have the latest deadline, so the list is searched from the tail.
+ * Entries with equal deadlines stay in the order they were scheduled.
+ *
+ * Must be called with `_sm_lock` held.
+ */
+static void _sm_pending_insert(int16_t index) {
+    _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+    int16_t after = _sm_tail;
+    while (after != _SM_NONE && _scheduled_message_datas[after].deadline > smd->deadline) {
+        after = _scheduled_message_datas[after].prev;
+    }
+    smd->prev = after;
+    if (after == _SM_NONE) {
+        smd->next = _sm_head;
+        _sm_head = index;
+    }
+    else {
+        smd->next = _scheduled_message_datas[after].next;
+        _scheduled_message_datas[after].next = index;
+    }
+    if (smd->next == _SM_NONE) {
+        _sm_tail = index;
+    }
+    else {
+        _scheduled_message_datas[smd->next].prev = index;
+    }
+}
+
+/**
+ * @brief Remove an entry from the pending list.
+ *
+ * Must be called with `_sm_lock` held.
+ */
+static void _sm_pending_remove(int16_t index) {
+    _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+    if (smd->prev == _SM_NONE) {
+        _sm_head = smd->next;
+    }
+    else {
+        _scheduled_message_datas[smd->prev].next = smd->next;
+    }
+    if (smd->next == _SM_NONE) {
+        _sm_tail = smd->prev;
+    }
+    else {
+        _scheduled_message_datas[smd->next].prev = smd->prev;
+    }
+}
+
+/**
+ * @brief Insert an entry into the pending list and the ID index.
+ *
+ * Must be called with `_sm_lock` held.
+ */
+static void _sm_link(int16_t index) {
+    _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+    _sm_pending_insert(index);
+    int bucket = _sm_id_bucket(smd->msg.id);
+    smd->id_prev = _SM_NONE;
+    smd->id_next = _sm_id_index[bucket];
+    if (smd->id_next != _SM_NONE) {
+        _scheduled_message_datas[smd->id_next].id_prev = index;
+    }
+    _sm_id_index[bucket] = index;
+    smd->active = true;
+    _sm_pending++;
+}
+
+/**
+ * @brief Remove a pending entry from the lists and return it to the free list.
+ *
+ * Must be called with `_sm_lock` held.
+ */
+static void _sm_release(int16_t index) {
+    _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+    _sm_pending_remove(index);
+    if (smd->id_prev == _SM_NONE) {
+        _sm_id_index[_sm_id_bucket(smd->msg.id)] = smd->id_next;
+    }
+    else {
+        _scheduled_message_datas[smd->id_prev].id_next = smd->id_next;
+    }
+    if (smd->id_next != _SM_NONE) {
+        _scheduled_message_datas[smd->id_next].id_prev = smd->id_prev;
+    }
+    if (0 == smd->period) {
+        for (int c = 0; c < 2; c++) {
+            if (smd->cores & (CMT_SM_CORE0 << c)) {
+                _sm_reserved[c]--;
+            }
+        }
+    }
+    smd->active = false;
+    smd->gen++;
+    smd->next = _sm_free;
+    _sm_free = index;
+    _sm_pending--;
+}
+
+/**
+ * @brief Advance a periodic entry to its next deadline and re-queue it.
+ *
+ * The next deadline is computed from the previous deadline (not from the current time),
+ * so the entry stays on its phase grid regardless of handler or interrupt latency. Whole
+ * periods that have already gone by are skipped and counted as missed.
+ *
+ * Must be called with `_sm_lock` held.
+ */
+static void _sm_periodic_advance(int16_t index, uint64_t now) {
+    _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+    _sm_pending_remove(index);
+    smd->deadline += smd->period;
+    if (smd->deadline <= now) {
+        uint64_t skipped = ((now - smd->deadline) / smd->period) + 1;
+        smd->missed += (uint32_t)skipped;
+        smd->deadline += (skipped * smd->period);
+    }
+    _sm_pending_insert(index);
+}
+
+/**
+ * @brief Arm the scheduled message alarm for the earliest deadline.
+ *
+ * If nothing is scheduled the alarm is cancelled, so there is no timer activity
+ * while no scheduled messages are waiting.
+ *
+ * Must be called with `_sm_lock` held.
+ *
+ * @return true if the earliest deadline has already passed (the alarm was not armed).
+ */
+static bool _sm_alarm_arm() {
+    if (_sm_head == _SM_NONE) {
+        hardware_alarm_cancel(_sm_alarm_num);
+        return (false);
+    }
+    return (hardware_alarm_set_target(_sm_alarm_num, from_us_since_boot(_scheduled_message_datas[_sm_head].deadline)));
+}
+
+/**
+ * @brief Post a due entry's message to the core(s) it is for.
+ *
+ * A one-shot message has a reserved slot (so it can't fail). A repeating message is only
+ * posted if there is a slot that isn't reserved, otherwise the period is counted as missed.
+ *
+ * Must be called with `_sm_lock` held.
+ */
+static void _sm_post(_scheduled_msg_data_t* smd) {
+    for (int c = 0; c < 2; c++) {
+        if (!(smd->cores & (CMT_SM_CORE0 << c))) {
+            continue;
+        }
+        cmt_msg_t msg = smd->msg;
+        bool room = (0 == smd->period || core_sched_slots_free((uint8_t)c) > _sm_reserved[c]);
+        if (!room || !post_scheduled_to_core((uint8_t)c, &msg)) {
+            smd->missed++;
+            _sm_missed[c]++;
+        }
+    }
+}
+
+/**
+ * @brief Scheduled message alarm callback handler.
+ * Posts the messages whose deadline has been reached to the appropriate core(s) and
+ * re-arms the alarm for the next earliest deadline.
+ *
+ * The messages go into the scheduled message rings, which have a slot reserved for each
+ * one-shot message, so nothing here waits, prints, or panics. A repeating message that
+ * can't be posted is counted, and the message loop of its core reports it later. The
+ * messages are posted with the lock held (in small batches, so the other core's scheduling
+ * calls aren't held off for long).
+ *
+ * @see hardware_alarm_callback_t
+ *
+ * \param alarm_num The hardware alarm number that fired. (not used)
+ */
+static void _sm_alarm_callback(uint alarm_num) {
+    bool more;
+
+    cmt_trace(CMT_TRACE_ISR_ENTER, (uint8_t)alarm_num, CMT_TRACE_ISR_B(CMT_TRACE_ISR_SRC_ALARM, 0));
+    do {
+        int due = 0;
+        uint32_t flags = spin_lock_blocking(_sm_lock);
+        uint64_t now = time_us_64();
+        while (due < _SM_DUE_BATCH && _sm_head != _SM_NONE && _scheduled_message_datas[_sm_head].deadline <= now) {
+            int16_t index = _sm_head;
+            _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+            if (smd->period) {
+                _sm_post(smd);
+                _sm_periodic_advance(index, now);
+            }
+            else {
+                _sm_release(index); // (releases its reservations, for the slots it is about to use)
+                _sm_post(smd);
+            }
+            due++;
+        }
+        more = (due == _SM_DUE_BATCH || _sm_alarm_arm());
+        spin_unlock(_sm_lock, flags);
+    } while (more);
+    cmt_trace(CMT_TRACE_ISR_EXIT, (uint8_t)alarm_num, CMT_TRACE_ISR_B(CMT_TRACE_ISR_SRC_ALARM, 0));
+}
+
+/**
+ * @brief Add a scheduled message entry.
+ *
+ * A one-shot entry reserves a slot in the scheduled message ring of each of its cores.
+ *
+ * @param cores The core(s) to post the message to (CMT_SM_CORE0 and/or CMT_SM_CORE1).
+ * @param us Microseconds from now to post the message.
+ * @param period Period in microseconds to repeat the message, or 0 to post it once.
+ * @param msg The message to post.
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if the pool is exhausted
+ *         (or a core's ring has no slot left to reserve), or the message has a payload.
+ */
+static cmt_sm_handle_t _sm_add(uint8_t cores, int64_t us, uint64_t period, const cmt_msg_t* msg) {
+    cmt_sm_handle_t handle = CMT_SM_HANDLE_INVALID;
+    bool missed = false;
+
+    if (0 == cores || (cores & ~CMT_SM_CORES)) {
+        return (CMT_SM_HANDLE_INVALID);
+    }
+    if (msg->flags & CMT_MSG_F_PAYLOAD) {
+        // It would be posted with the same payload reference each time it is posted (and a
+        // repeating one every period), so the reference would be released more than once.
+        return (CMT_SM_HANDLE_INVALID);
+    }
+    uint64_t deadline = time_us_64() + (us > 0 ? us : 0);
+    uint32_t flags = spin_lock_blocking(_sm_lock);
+    int16_t index = _sm_free;
+    if (index != _SM_NONE && 0 == period) {
+        for (int c = 0; c < 2; c++) {
+            if ((cores & (CMT_SM_CORE0 << c)) && core_sched_slots_free((uint8_t)c) <= _sm_reserved[c]) {
+                index = _SM_NONE; // No slot to reserve
+            }
+        }
+        if (index != _SM_NONE) {
+            for (int c = 0; c < 2; c++) {
+                if (cores & (CMT_SM_CORE0 << c)) {
+                    _sm_reserved[c]++;
                 }
-                smd->remaining = _SMD_FREE_INDICATOR;
             }
         }
     }
+    if (index != _SM_NONE) {
+        _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+        _sm_free = smd->next;
+        smd->msg = *msg;
+        smd->cores = cores;
+        smd->deadline = deadline;
+        smd->period = period;
+        smd->missed = 0;
+        _sm_link(index);
+        if (index == _sm_head) {
+            // New earliest deadline
+            missed = _sm_alarm_arm();
+        }
+        handle = _sm_handle(index);
+    }
+    spin_unlock(_sm_lock, flags);
+    if (missed) {
+        // Already due (0 time, or very short). Let the alarm handler post it.
+        hardware_alarm_force_irq(_sm_alarm_num);
+    }
 
-    return (true); // Repeat forever
+    return (handle);
 }
 
 static void _scheduled_msg_init() {
-    for (int i = 0; i < _SCHEDULED_MESSAGES_MAX; i++) {
+    for (int i = 0; i < CMT_SCHEDULED_MESSAGES_MAX; i++) {
         // Initialize these as 'free'
         _scheduled_msg_data_t* smd = &_scheduled_message_datas[i];
-        smd->remaining = _SMD_FREE_INDICATOR;
+        smd->active = false;
+        smd->gen = 1;
+        smd->next = (i + 1 < CMT_SCHEDULED_MESSAGES_MAX ? i + 1 : _SM_NONE);
     }
-    bool success = add_repeating_timer_us((1000 - _SM_OVERHEAD_US_PER_MS), _schd_msg_timer_callback, NULL, &_schd_msg_timer_data);
-    if (!success) {
-        error_printf("CMT - Could not create repeating timer for scheduled messages.\n");
-        panic("CMT - Could not create repeating timer for scheduled messages.");
+    _sm_free = 0;
+    _sm_head = _SM_NONE;
+    _sm_tail = _SM_NONE;
+    for (int i = 0; i < _SM_ID_BUCKETS; i++) {
+        _sm_id_index[i] = _SM_NONE;
     }
+    _sm_pending = 0;
+    for (int c = 0; c < 2; c++) {
+        _sm_reserved[c] = 0;
+        _sm_missed[c] = 0;
+        _sm_missed_reported[c] = 0;
+    }
+    _sm_lock = spin_lock_init(spin_lock_claim_unused(true));
+    int alarm_num = hardware_alarm_claim_unused(false);
+    if (alarm_num < 0) {
+        error_printf("CMT - Could not claim a hardware alarm for scheduled messages.\n");
+        panic("CMT - Could not claim a hardware alarm for scheduled messages.");
+    }
+    _sm_alarm_num = (uint)alarm_num;
+    hardware_alarm_set_callback(_sm_alarm_num, _sm_alarm_callback);
 }
 
 bool cmt_message_loop_0_running() {
@@ -99,151 +643,322 @@ bool cmt_message_loops_running() {
     return (_msg_loop_0_running && _msg_loop_1_running);
 }
 
+void cmt_msg_deadline_set(cmt_msg_t* msg, uint32_t us) {
+    uint32_t deadline = time_us_32() + us;
+    msg->deadline = (deadline ? deadline : 1); // 0 means 'no deadline'
+}
+
 void cmt_handle_sleep(cmt_msg_t* msg) {
-    cmt_sleep_fn fn = msg->data.cmt_sleep->sleep_fn;
+    cmt_sleep_fn fn = msg->data.cmt_sleep.sleep_fn;
     if (fn) {
-        (fn)(msg->data.cmt_sleep->user_data);
+        (fn)(msg->data.cmt_sleep.user_data);
     }
 }
 
-void cmt_proc_status_sec(proc_status_accum_t* psas, uint8_t corenum) {
-    if (corenum < 2) {
-        proc_status_accum_t* psa_sec = &_psa_sec[corenum];
-        proc_status_accum_t psa;
-        int64_t cs = 0;
-        do {
-            psa.cs = psa_sec->cs;   // Get the 'per-sec' checksum
-            psa.core_temp = psa_sec->core_temp;
-            psa.idle = psa_sec->idle;
-            cs = psa.idle;
-            psa.retrived = psa_sec->retrived;
-            cs += psa.retrived;
-            psa.t_active = psa_sec->t_active;
-            cs += psa.t_active;
-            psa.t_idle = psa_sec->t_idle;
-            cs += psa.t_idle;
-            psa.t_msgr = psa_sec->t_msgr;
-            cs += psa.t_msgr;
-            psa.int_status = psa_sec->int_status;
-            cs += psa.int_status;
-            psa.ts_psa = psa_sec->ts_psa;
-
-        } while(psa.cs != cs);
-        psas->core_temp = psa.core_temp;
-        psas->idle = psa.idle;
-        psas->retrived = psa.retrived;
-        psas->t_active = psa.t_active;
-        psas->t_idle = psa.t_idle;
-        psas->t_msgr = psa.t_msgr;
-        psas->int_status = psa.int_status;
-        psas->ts_psa = psa.ts_psa;
-        psas->cs = psa.cs;
+bool cmt_msg_stats(uint8_t corenum, msg_id_t id, cmt_msg_stats_t* stats) {
+#if CMT_MSG_STATS
+    int index = cmt_msg_id_index(id);
+    if (corenum > 1 || index < 0) {
+        return (false);
     }
+    uint32_t seq;
+    do {
+        seq = _msg_stats_seq[corenum];
+        __dmb();
+        memcpy(stats, &_msg_stats[corenum][index], sizeof(cmt_msg_stats_t));
+        __dmb();
+    } while ((seq & 1) || seq != _msg_stats_seq[corenum]);
+    return (true);
+#else
+    return (false);
+#endif
 }
 
-int cmt_sched_msg_waiting() {
-    int count = 0;
-    uint32_t flags = save_and_disable_interrupts();
-    mutex_enter_blocking(&sm_mutex);
-    for (int i = 0; i < _SCHEDULED_MESSAGES_MAX; i++) {
-        _scheduled_msg_data_t* smd = &_scheduled_message_datas[i];
-        if (_SMD_FREE_INDICATOR != smd->remaining) {
-            count++;
+void cmt_msg_stats_print(uint8_t corenum) {
+#if CMT_MSG_STATS
+    printf("Core %d message stats (Q: time in queue, H: handler time):\n", corenum);
+    for (uint block = 0; block < count_of(_msg_block_cnt); block++) {
+        for (uint offset = 0; offset < _msg_block_cnt[block]; offset++) {
+            msg_id_t id = (msg_id_t)((block << 8) | offset);
+            cmt_msg_stats_t stats;
+            if (!cmt_msg_stats(corenum, id, &stats) || stats.count == 0) {
+                continue;
+            }
+            printf(" %#04.4x Count:%lu Qmax:%luus Hmax:%luus\n", id, (unsigned long)stats.count,
+                (unsigned long)stats.queue_max_us, (unsigned long)stats.handler_max_us);
+            _msg_hist_print("   Q:", stats.queue_hist);
+            _msg_hist_print("   H:", stats.handler_hist);
         }
     }
-    mutex_exit(&sm_mutex);
-    restore_interrupts(flags);
+#endif
+}
 
-    return (count);
+void cmt_msg_stats_reset(uint8_t corenum) {
+#if CMT_MSG_STATS
+    if (corenum < 2) {
+        if ((corenum == 0 && _msg_loop_0_running) || (corenum == 1 && _msg_loop_1_running)) {
+            _msg_stats_reset_req[corenum] = true;
+        }
+        else {
+            _msg_stats_clear(corenum);
+        }
+    }
+#endif
 }
 
-void cmt_sleep_ms(int32_t ms, cmt_sleep_fn sleep_fn, void* user_data) {
-    bool scheduled = false;
+void cmt_proc_status_sec(proc_status_accum_t* psas, uint8_t corenum) {
+    if (corenum < 2) {
+        _psa_read(corenum, psas, &_psa_sec[corenum], sizeof(proc_status_accum_t));
+    }
+}
 
-    uint8_t core_num = (uint8_t)get_core_num();
-    uint32_t flags = save_and_disable_interrupts();
-    mutex_enter_blocking(&sm_mutex);
-    // Get a free smd
-    for (int i = 0; i < _SCHEDULED_MESSAGES_MAX; i++) {
-        _scheduled_msg_data_t* smd = &_scheduled_message_datas[i];
-        if (_SMD_FREE_INDICATOR == smd->remaining) {
-            // This is free;
-            smd->sleep_msg.id = MSG_CMT_SLEEP;
-            smd->sleep_msg.data.cmt_sleep->sleep_fn = sleep_fn;
-            smd->sleep_msg.data.cmt_sleep->user_data = user_data;
-            smd->client_msg = &smd->sleep_msg;
-            smd->ms_requested = ms;
-            smd->corenum = core_num;
-            smd->remaining = ms;
-            scheduled = true;
-            break;
+int cmt_handler_usage_sec(uint8_t corenum, cmt_fn_usage_t* usage, int max) {
+    if (corenum > 1) {
+        return (0);
+    }
+    _fn_accum_t sec[CMT_DISPATCH_HANDLERS_MAX];
+    int n = 0;
+    for (int shared = 0; shared < 2; shared++) {
+        const _msg_dispatch_t* dt = (shared ? &_shared_dispatch : &_dispatch[corenum]);
+        _psa_read(corenum, sec, (shared ? _shared_sec[corenum] : _handler_sec[corenum]), sizeof(sec));
+        for (int i = 0; i < CMT_MSG_ID_CNT; i++) {
+            for (int h = dt->first[i]; h < dt->first[i + 1] && n < max; h++, n++) {
+                usage[n].handler = dt->handlers[h];
+                usage[n].idle = NULL;
+                usage[n].msg_id = _msg_id_of_index(i);
+                usage[n].calls = sec[h].calls;
+                usage[n].t_us = sec[h].t_us;
+                usage[n].overruns = 0;
+            }
         }
     }
-    mutex_exit(&sm_mutex);
-    restore_interrupts(flags);
-    if (!scheduled) {
-        panic("CMT - No SMD available for use.");
+    return (n);
+}
+
+int cmt_idle_usage_sec(uint8_t corenum, cmt_fn_usage_t* usage, int max) {
+    if (corenum > 1) {
+        return (0);
+    }
+    _fn_accum_t sec[CMT_IDLE_TASKS_MAX];
+    _psa_read(corenum, sec, _idle_sec[corenum], sizeof(sec));
+    int n = 0;
+    for (; n < _idle_task_cnt[corenum] && n < max; n++) {
+        usage[n].handler = NULL;
+        usage[n].idle = _idle_tasks[corenum][n]->idle;
+        usage[n].msg_id = -1;
+        usage[n].calls = sec[n].calls;
+        usage[n].t_us = sec[n].t_us;
+        usage[n].overruns = sec[n].overruns;
     }
+    return (n);
 }
 
-void schedule_msg_in_ms(int32_t ms, cmt_msg_t* msg) {
-    bool scheduled = false;
+uint32_t cmt_idle_time_left_us(void) {
+    uint corenum = get_core_num();
+    uint32_t budget = _idle_budget_us[corenum];
+    if (0 == budget) {
+        return (UINT32_MAX);
+    }
+    uint32_t used = time_us_32() - _idle_budget_start[corenum];
+    return (used < budget ? budget - used : 0);
+}
 
-    uint8_t core_num = (uint8_t)get_core_num();
-    uint32_t flags = save_and_disable_interrupts();
-    mutex_enter_blocking(&sm_mutex);
-    // Get a free smd
-    for (int i = 0; i < _SCHEDULED_MESSAGES_MAX; i++) {
-        _scheduled_msg_data_t* smd = &_scheduled_message_datas[i];
-        if (_SMD_FREE_INDICATOR == smd->remaining) {
-            // This is free;
-            smd->client_msg = msg;
-            smd->ms_requested = ms;
-            smd->corenum = core_num;
-            smd->remaining = ms;
-            scheduled = true;
-            break;
-        }
+int cmt_sched_msg_waiting() {
+    return (_sm_pending);
+}
+
+uint32_t cmt_sched_msg_missed(uint8_t corenum) {
+    return (corenum < 2 ? _sm_missed[corenum] : 0);
+}
+
+static inline uint8_t _sm_this_core(void) {
+    return ((uint8_t)(CMT_SM_CORE0 << get_core_num()));
+}
+
+cmt_sm_handle_t cmt_sleep_ms(int32_t ms, cmt_sleep_fn sleep_fn, void* user_data) {
+    cmt_msg_t msg = { MSG_CMT_SLEEP, CMT_MSG_PRIO_URGENT }; // Sleep continuations are timing related
+    msg.data.cmt_sleep.sleep_fn = sleep_fn;
+    msg.data.cmt_sleep.user_data = user_data;
+    return (_sm_add(_sm_this_core(), ((int64_t)ms * 1000), 0, &msg));
+}
+
+cmt_sm_handle_t schedule_msg_in_ms(int32_t ms, const cmt_msg_t* msg) {
+    return (_sm_add(_sm_this_core(), ((int64_t)ms * 1000), 0, msg));
+}
+
+cmt_sm_handle_t schedule_msg_in_us(int64_t us, const cmt_msg_t* msg) {
+    return (_sm_add(_sm_this_core(), us, 0, msg));
+}
+
+cmt_sm_handle_t schedule_msg_every_ms(int32_t period_ms, const cmt_msg_t* msg) {
+    return (schedule_core_msg_every_us(_sm_this_core(), ((int64_t)period_ms * 1000), msg));
+}
+
+cmt_sm_handle_t schedule_msg_every_us(int64_t period_us, const cmt_msg_t* msg) {
+    return (schedule_core_msg_every_us(_sm_this_core(), period_us, msg));
+}
+
+cmt_sm_handle_t schedule_core_msg_in_ms(uint8_t cores, int32_t ms, const cmt_msg_t* msg) {
+    return (_sm_add(cores, ((int64_t)ms * 1000), 0, msg));
+}
+
+cmt_sm_handle_t schedule_core_msg_in_us(uint8_t cores, int64_t us, const cmt_msg_t* msg) {
+    return (_sm_add(cores, us, 0, msg));
+}
+
+cmt_sm_handle_t schedule_core_msg_every_ms(uint8_t cores, int32_t period_ms, const cmt_msg_t* msg) {
+    return (schedule_core_msg_every_us(cores, ((int64_t)period_ms * 1000), msg));
+}
+
+cmt_sm_handle_t schedule_core_msg_every_us(uint8_t cores, int64_t period_us, const cmt_msg_t* msg) {
+    if (period_us <= 0) {
+        return (CMT_SM_HANDLE_INVALID);
     }
-    mutex_exit(&sm_mutex);
-    restore_interrupts(flags);
-    if (!scheduled) {
-        panic("CMT - No SM Data slot available for use.");
+    return (_sm_add(cores, period_us, (uint64_t)period_us, msg));
+}
+
+uint32_t scheduled_msg_handle_missed(cmt_sm_handle_t handle) {
+    uint32_t missed = 0;
+    uint32_t flags = spin_lock_blocking(_sm_lock);
+    int16_t index = _sm_index(handle);
+    if (index != _SM_NONE) {
+        missed = _scheduled_message_datas[index].missed;
     }
+    spin_unlock(_sm_lock, flags);
+    return (missed);
 }
 
+bool scheduled_msg_handle_cancel(cmt_sm_handle_t handle) {
+    bool cancelled = false;
+    uint32_t flags = spin_lock_blocking(_sm_lock);
+    int16_t index = _sm_index(handle);
+    if (index != _SM_NONE) {
+        // The alarm is left as is, and will simply re-arm for the next deadline if it
+        // fires with nothing due.
+        _sm_release(index);
+        cancelled = true;
+    }
+    spin_unlock(_sm_lock, flags);
+    return (cancelled);
+}
+
+bool scheduled_msg_handle_pending(cmt_sm_handle_t handle) {
+    uint32_t flags = spin_lock_blocking(_sm_lock);
+    bool pending = (_sm_index(handle) != _SM_NONE);
+    spin_unlock(_sm_lock, flags);
+    return (pending);
+}
 
 void scheduled_msg_cancel(msg_id_t sched_msg_id) {
-    uint32_t flags = save_and_disable_interrupts();
-    mutex_enter_blocking(&sm_mutex);
-    for (int i = 0; i < _SCHEDULED_MESSAGES_MAX; i++) {
-        _scheduled_msg_data_t* smd = &_scheduled_message_datas[i];
-        if (smd->client_msg && smd->client_msg->id == sched_msg_id) {
-            // This matches, so set the remaining to -1;
-            smd->remaining = _SMD_FREE_INDICATOR;
+    uint32_t flags = spin_lock_blocking(_sm_lock);
+    int16_t index = _sm_id_index[_sm_id_bucket(sched_msg_id)];
+    while (index != _SM_NONE) {
+        _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+        int16_t next = smd->id_next;
+        if (smd->msg.id == sched_msg_id) {
+            _sm_release(index);
         }
+        index = next;
     }
-    mutex_exit(&sm_mutex);
-    restore_interrupts(flags);
+    spin_unlock(_sm_lock, flags);
 }
 
 extern bool scheduled_message_exists(msg_id_t sched_msg_id) {
     bool exists = false;
-    uint32_t flags = save_and_disable_interrupts();
-    mutex_enter_blocking(&sm_mutex);
-    for (int i = 0; i < _SCHEDULED_MESSAGES_MAX; i++) {
-        _scheduled_msg_data_t* smd = &_scheduled_message_datas[i];
-        if (smd->client_msg && smd->client_msg->id == sched_msg_id) {
+    uint32_t flags = spin_lock_blocking(_sm_lock);
+    int16_t index = _sm_id_index[_sm_id_bucket(sched_msg_id)];
+    while (index != _SM_NONE) {
+        _scheduled_msg_data_t* smd = &_scheduled_message_datas[index];
+        if (smd->msg.id == sched_msg_id) {
             // This matches
             exists = true;
             break;
         }
+        index = smd->id_next;
     }
-    mutex_exit(&sm_mutex);
-    restore_interrupts(flags);
+    spin_unlock(_sm_lock, flags);
     return (exists);
 }
 
+/**
+ * @brief Take a message from the shared work queue (if there is one that can be handled) and
+ *        run its core-agnostic handlers.
+ *
+ * @param corenum The core number of the calling message loop.
+ * @param t_start The time the loop started looking for work (counted as message retrieval).
+ * @return true if a message was handled.
+ */
+/**
+ * @brief Take the time the calling core has spent in `cmt_shared_help` since this was last
+ *        called.
+ *
+ * That time is charged by `_shared_run`, so the handler, coroutine or idle task that was
+ * waiting on a shared post (and helped) leaves it out of its own time.
+ */
+static inline uint32_t _shared_helped_take(uint8_t corenum) {
+    uint32_t us = _shared_helped_us[corenum];
+    _shared_helped_us[corenum] = 0;
+    return (us);
+}
+
+static bool _shared_run(uint8_t corenum, uint32_t t_start) {
+    cmt_msg_t msg;
+    if (!get_shared_msg_nowait(&msg)) {
+        return (false);
+    }
+    proc_status_accum_t* psa = &_psa[corenum];
+    _fn_accum_t* shared_accum = _shared_accum[corenum];
+    uint32_t taken = time_us_32();
+    uint32_t hs = taken;
+    uint32_t helped = 0;
+    psa->t_msgr += taken - t_start;
+    psa->retrived++;
+    int index = cmt_msg_id_index(msg.id); // (valid, checked by the post)
+    cmt_trace(CMT_TRACE_TAKE, 0, msg.id); // (batch of 0 - from the shared work queue)
+    for (int h = _shared_dispatch.first[index]; h < _shared_dispatch.first[index + 1]; h++) {
+        cmt_trace(CMT_TRACE_HANDLER_START, (uint8_t)h, msg.id);
+        _shared_dispatch.handlers[h](&msg);
+        cmt_trace(CMT_TRACE_HANDLER_END, (uint8_t)h, msg.id);
+        uint32_t he = time_us_32();
+        uint32_t h_helped = _shared_helped_take(corenum);
+        shared_accum[h].calls++;
+        shared_accum[h].t_us += he - hs - h_helped;
+        helped += h_helped;
+        hs = he;
+    }
+    shared_msg_done(&msg);
+#if CMT_MSG_STATS
+    _msg_stats_record(corenum, index, taken - msg.t, hs - taken - helped);
+#endif
+    psa->t_active += hs - taken - helped;
+    return (true);
+}
+
+bool cmt_shared_help(void) {
+    if (__get_current_exception()) {
+        return (false);
+    }
+    uint8_t corenum = (uint8_t)get_core_num();
+    if (!(0 == corenum ? _msg_loop_0_running : _msg_loop_1_running)) {
+        return (false);
+    }
+    uint32_t start = time_us_32();
+    if (!_shared_run(corenum, start)) {
+        return (false);
+    }
+    // The caller is nested in a handler, coroutine or idle task, whose time this is part of
+    _shared_helped_us[corenum] += time_us_32() - start;
+    return (true);
+}
+
+bool cmt_shared_handlers_set(const msg_handler_entry_t** handler_entries) {
+    if (_msg_loop_0_running || _msg_loop_1_running) {
+        return (false);
+    }
+    _dispatch_build(&_shared_dispatch, handler_entries);
+    return (true);
+}
+
 /*
  * Endless loop reading and dispatching messages.
  * This is called/started once from each core, so two instances are running.
@@ -251,12 +966,29 @@ extern bool scheduled_message_exists(msg_id_t sched_msg_id) {
 void message_loop(const msg_loop_cntx_t* loop_context) {
     // Setup occurs once when called by a core.
     uint8_t corenum = loop_context->corenum;
-    get_msg_nowait_fn get_msg_function = (corenum == 0 ? get_core0_msg_nowait : get_core1_msg_nowait);
-    cmt_msg_t msg;
-    const idle_fn* idle_functions = loop_context->idle_functions;
+    get_msgs_nowait_fn get_msgs_function = (corenum == 0 ? get_core0_msgs_nowait : get_core1_msgs_nowait);
+    cmt_msg_t msgs[CMT_MSG_BATCH_MAX];
+    const idle_task_entry_t** idle_tasks = loop_context->idle_tasks;
     proc_status_accum_t *psa = &_psa[corenum];
-    proc_status_accum_t *psa_sec = &_psa_sec[corenum];
-    psa->ts_psa = now_ms();
+    _fn_accum_t* handler_accum = _handler_accum[corenum];
+    _fn_accum_t* idle_accum = _idle_accum[corenum];
+    _idle_task_state_t* idle_state = _idle_state[corenum];
+    const _msg_dispatch_t* dispatch = &_dispatch[corenum];
+    _dispatch_build(&_dispatch[corenum], loop_context->handler_entries);
+    int idle_cnt = 0;
+    while (idle_tasks[idle_cnt]) {
+        if (++idle_cnt > CMT_IDLE_TASKS_MAX) {
+            panic("CMT - Too many idle tasks (max: %d).", CMT_IDLE_TASKS_MAX);
+        }
+    }
+    int idle_next = 0; // Idle task to check first (round-robin)
+    _idle_tasks[corenum] = idle_tasks;
+    _idle_task_cnt[corenum] = idle_cnt;
+    psa->ts_psa = time_us_32();
+    for (int i = 0; i < idle_cnt; i++) {
+        idle_state[i].last_run = psa->ts_psa - idle_tasks[i]->interval_us; // Due right away
+        idle_state[i].ran = false;
+    }
 
     // Indicate that the message loop is running for the calling core.
     if (corenum == 0) {
@@ -267,73 +999,166 @@ void message_loop(const msg_loop_cntx_t* loop_context) {
     }
 
     // Enter into the endless loop reading and dispatching messages to the handlers...
+    // (Times are taken from the microsecond timer. Each reading is used as the end of
+    // one period and the start of the next, so no time goes unaccounted for.)
     while (1) {
-        uint32_t t_start = now_ms();
-        // Store and reset the process status accumulators once every second
-        if (t_start - psa->ts_psa >= ONE_SECOND_MS) {
-            int64_t cs = 0;
-            psa_sec->cs = -1;
-            psa_sec->idle = psa->idle;
-            cs += psa_sec->idle;
-            psa->idle = 0;
-            psa_sec->retrived = psa->retrived;
-            cs += psa_sec->retrived;
-            psa->retrived = 0;
-            psa_sec->t_active = psa->t_active;
-            cs += psa_sec->t_active;
-            psa->t_active = 0;
-            psa_sec->t_idle = psa->t_idle;
-            cs += psa_sec->t_idle;
-            psa->t_idle = 0;
-            psa_sec->t_msgr = psa->t_msgr;
-            cs += psa_sec->t_msgr;
-            psa->t_msgr = 0;
-            psa_sec->int_status = nvic_hw->iser;
-            cs += psa_sec->int_status;
-            psa_sec->core_temp = onboard_temp_c();
-            psa_sec->ts_psa = t_start;
-            psa->ts_psa = t_start;
-            psa_sec->cs = cs;
+        uint32_t t_start = time_us_32();
+        // Publish and reset the process status accumulators once every second
+        if (t_start - psa->ts_psa >= (ONE_SECOND_MS * 1000)) {
+            _psa_publish(corenum, t_start);
+            // Report scheduled message posts the alarm interrupt couldn't make (it can't print)
+            uint32_t sm_missed = _sm_missed[corenum];
+            if (sm_missed != _sm_missed_reported[corenum]) {
+                warn_printf("CMT - Core %d missed %u repeating scheduled message posts (it is behind).\n",
+                    corenum, (unsigned)(sm_missed - _sm_missed_reported[corenum]));
+                _sm_missed_reported[corenum] = sm_missed;
+            }
+            // Charge the publish (and its temperature read) to the new period's messaging time
+            uint32_t tp = time_us_32();
+            psa->t_msgr += tp - t_start;
+            t_start = tp;
+        }
+        // Run the coroutines whose wait time has passed (charged as active time, the same as
+        // the coroutines run for a message)
+        if (cmt_co_timers_run(corenum, t_start)) {
+            uint32_t tc = time_us_32();
+            psa->t_active += tc - t_start - _shared_helped_take(corenum);
+            t_start = tc;
         }
 
-        if (get_msg_function(&msg)) {
-            uint32_t as = now_ms();
-            psa->t_msgr += as - t_start;
-            psa->retrived++;
-            // Find the handler
-            const msg_handler_entry_t** handler_entries = loop_context->handler_entries;
-            while (*handler_entries) {
-                const msg_handler_entry_t* handler_entry = *handler_entries++;
-                if (msg.id == handler_entry->msg_id) {
-                    handler_entry->msg_handler(&msg);
+#if CMT_MSG_STATS
+        if (_msg_stats_reset_req[corenum]) {
+            _msg_stats_clear(corenum);
+        }
+#endif
+        // Take a batch of messages
+        uint16_t count = get_msgs_function(msgs, CMT_MSG_BATCH_MAX);
+        if (count > 0) {
+            uint32_t taken = time_us_32();  // Time the messages were taken from the queue
+            uint32_t hs = taken;            // Start time of the current handler
+            uint32_t helped = 0;            // Time helping with shared work (charged by that)
+            psa->t_msgr += taken - t_start;
+            psa->retrived += count;
+            for (int m = 0; m < count; m++) {
+                // Call the handler(s) for the message
+                cmt_msg_t* msg = &msgs[m];
+                int index = cmt_msg_id_index(msg->id);
+                cmt_trace(CMT_TRACE_TAKE, (uint8_t)count, msg->id);
+                if (index >= 0) {
+#if CMT_MSG_STATS
+                    uint32_t ms = hs;
+                    uint32_t m_helped = helped;
+#endif
+                    for (int h = dispatch->first[index]; h < dispatch->first[index + 1]; h++) {
+                        cmt_trace(CMT_TRACE_HANDLER_START, (uint8_t)h, msg->id);
+                        dispatch->handlers[h](msg);
+                        cmt_trace(CMT_TRACE_HANDLER_END, (uint8_t)h, msg->id);
+                        uint32_t he = time_us_32();
+                        uint32_t h_helped = _shared_helped_take(corenum);
+                        handler_accum[h].calls++;
+                        handler_accum[h].t_us += he - hs - h_helped;
+                        helped += h_helped;
+                        hs = he;
+                    }
+                    // Then the coroutines waiting for it
+                    if (cmt_co_msg_deliver(corenum, msg, index)) {
+                        hs = time_us_32();
+                        helped += _shared_helped_take(corenum);
+                    }
+#if CMT_MSG_STATS
+                    // Time in queue is from the post until it was taken (not including the
+                    // handlers for the messages ahead of it in the batch).
+                    _msg_stats_record(corenum, index, taken - msg->t, hs - ms - (helped - m_helped));
+#endif
                 }
+                // The handlers are done with it, release any payload
+                if (msg->flags & CMT_MSG_F_PAYLOAD) {
+                    cmt_msg_payload_release(msg, corenum);
+                    hs = time_us_32();
+                }
+            }
+            psa->t_active += hs - taken - helped;
+            // Help with the shared work if it is backing up
+            if (shared_msgs_waiting() >= (CMT_SHARED_QUEUE_DEPTH / 2)) {
+                _shared_run(corenum, hs);
             }
-            // No more handlers found for this message.
-            uint32_t ht = now_ms() - as;
-            psa->t_active += ht;
+        }
+        else if (_shared_run(corenum, t_start)) {
+            // No message available, but there was shared work
         }
         else {
-            // No message available, allow next idle function to run
-            int32_t is = now_ms();
+            // No message available, run the next idle task that is due
+            uint32_t is = time_us_32();
             psa->t_msgr += is - t_start;
             psa->idle++;
-            const idle_fn idle_function = *idle_functions;
-            if (idle_function) {
-                idle_function();
-                idle_functions++; // Next time do the next one...
+            int run = -1;
+            uint32_t wait_us = CMT_IDLE_SLEEP_MAX_US; // Time until the next task is due
+            for (int i = 0; i < idle_cnt; i++) {
+                int n = (idle_next + i < idle_cnt ? idle_next + i : idle_next + i - idle_cnt);
+                uint32_t interval = idle_tasks[n]->interval_us;
+                uint32_t since = is - idle_state[n].last_run;
+                if (since >= interval) {
+                    if (!idle_state[n].ran) {
+                        run = n;
+                        break;
+                    }
+                    wait_us = 0; // It is due again already (it will run in the next pass)
+                }
+                else if (interval - since < wait_us) {
+                    wait_us = interval - since;
+                }
+            }
+            uint32_t co_wait = cmt_co_wait_us(corenum, is);
+            if (co_wait < wait_us) {
+                wait_us = co_wait; // A coroutine wait ends before then
+            }
+            if (run >= 0) {
+                const idle_task_entry_t* task = idle_tasks[run];
+                idle_state[run].ran = true;
+                idle_state[run].last_run = is;
+                _idle_budget_start[corenum] = is;
+                _idle_budget_us[corenum] = task->budget_us;
+                cmt_trace(CMT_TRACE_IDLE_START, (uint8_t)run, 0);
+                task->idle();
+                cmt_trace(CMT_TRACE_IDLE_END, (uint8_t)run, 0);
+                _idle_budget_us[corenum] = 0;
+                uint32_t ie = time_us_32();
+                uint32_t it = ie - is - _shared_helped_take(corenum);
+                _fn_accum_t* ia = &idle_accum[run];
+                ia->calls++;
+                ia->t_us += it;
+                if (task->budget_us && it > task->budget_us) {
+                    ia->overruns++;
+                }
+                psa->t_idle += it;
+                idle_next = (run + 1 < idle_cnt ? run + 1 : 0);
             }
             else {
-                // end of function list
-                idle_functions = loop_context->idle_functions; // reset the pointer
+                // Every task that is due has had a turn. Start a new idle pass.
+                for (int i = 0; i < idle_cnt; i++) {
+                    idle_state[i].ran = false;
+                }
+#if CMT_IDLE_SLEEP_MAX_US > 0
+                // Sleep until a message is posted (posting does a SEV), an interrupt occurs, or
+                // the next task (or coroutine wait) is due. A post made after the queue was
+                // checked has already set the event, so the WFE returns right away rather than
+                // missing it.
+                if (wait_us > 0) {
+                    best_effort_wfe_or_timeout(make_timeout_time_us(wait_us));
+                    psa->t_sleep += time_us_32() - is;
+                }
+#else
+                (void)wait_us;
+#endif
             }
-            uint32_t it = now_ms() - is;
-            psa->t_idle += it;
         }
     }
 }
 
 void cmt_module_init() {
-    mutex_enter_blocking(&sm_mutex);
     _scheduled_msg_init();
-    mutex_exit(&sm_mutex);
+    // The common 'changed' messages only say that something changed, so a burst of them
+    // only needs to be handled once.
+    core_msg_coalesce_set(MSG_CONFIG_CHANGED, true);
+    core_msg_coalesce_set(MSG_DEBUG_CHANGED, true);
 }
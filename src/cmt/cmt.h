@@ -17,24 +17,62 @@ extern "C" {
 #include <stdint.h>
 #include "pico/types.h"
 
+/**
+ * @brief Message IDs.
+ *
+ * The IDs are in blocks (0x0000 Common, 0x0100 Back-End, 0x0200 UI). Each block ends
+ * with an `_END` marker (not a message) that the message dispatching uses to size its
+ * lookup table, so new messages must be added before the marker of their block.
+ */
 typedef enum _MSG_ID_ {
     // Common messages (used by both BE and UI)
     MSG_COMMON_NOOP = 0x0000,
     MSG_CONFIG_CHANGED,
     MSG_DEBUG_CHANGED,
+    MSG_COMMON_END,         // (marker - must be last in the block)
     //
     // Back-End messages
     MSG_BACKEND_NOOP = 0x0100,
     MSG_BE_TEST,
     MSG_CMT_SLEEP,
     MSG_UI_INITIALIZED,
+    MSG_BACKEND_END,        // (marker - must be last in the block)
     //
     // Front-End/UI messages
     MSG_UI_NOOP = 0x0200,
     MSG_BE_INITIALIZED,
     MSG_DISPLAY_MESSAGE,
+    MSG_UI_END,             // (marker - must be last in the block)
 } msg_id_t;
 
+// The number of IDs in each message ID block, and in all of them.
+#define CMT_MSG_COMMON_CNT (MSG_COMMON_END - MSG_COMMON_NOOP)
+#define CMT_MSG_BACKEND_CNT (MSG_BACKEND_END - MSG_BACKEND_NOOP)
+#define CMT_MSG_UI_CNT (MSG_UI_END - MSG_UI_NOOP)
+#define CMT_MSG_ID_CNT (CMT_MSG_COMMON_CNT + CMT_MSG_BACKEND_CNT + CMT_MSG_UI_CNT)
+
+/**
+ * @brief Get the dense (0 to CMT_MSG_ID_CNT-1) index for a message ID.
+ * @ingroup cmt
+ *
+ * Used to keep tables indexed by message ID.
+ *
+ * @param id The message ID.
+ * @return The index, or -1 if the ID isn't within one of the message blocks.
+ */
+static inline int cmt_msg_id_index(int id) {
+    unsigned int offset = ((unsigned int)id & 0xFF);
+    switch ((unsigned int)id >> 8) {
+        case 0:
+            return (offset < CMT_MSG_COMMON_CNT ? (int)offset : -1);
+        case 1:
+            return (offset < CMT_MSG_BACKEND_CNT ? (int)(CMT_MSG_COMMON_CNT + offset) : -1);
+        case 2:
+            return (offset < CMT_MSG_UI_CNT ? (int)(CMT_MSG_COMMON_CNT + CMT_MSG_BACKEND_CNT + offset) : -1);
+    }
+    return (-1);
+}
+
 /**
  * @brief Function prototype for a sleep function.
  * @ingroup cmt
@@ -46,6 +84,32 @@ typedef struct _cmt_sleep_data_ {
     void* user_data;
 } _cmt_sleep_data_t;
 
+/**
+ * @brief Handle for a scheduled message.
+ * @ingroup cmt
+ *
+ * Returned when a message is scheduled, and used to cancel (or check on) that specific
+ * scheduled message. A handle is invalidated once its message has been posted or cancelled.
+ */
+typedef uint32_t cmt_sm_handle_t;
+
+#ifndef CMT_SCHEDULED_MESSAGES_MAX
+#define CMT_SCHEDULED_MESSAGES_MAX 32   // Capacity of the scheduled message pool (can be set by the build)
+#endif
+#ifndef CMT_SCHED_QUEUE_DEPTH
+#define CMT_SCHED_QUEUE_DEPTH 32        // Entries in each scheduled message ring (power of 2, at least CMT_SCHEDULED_MESSAGES_MAX)
+#endif
+
+/** @brief Value returned when a message could not be scheduled (the pool is exhausted). */
+#define CMT_SM_HANDLE_INVALID ((cmt_sm_handle_t)0)
+
+/** @brief Scheduled message target: Core 0. */
+#define CMT_SM_CORE0 0x01
+/** @brief Scheduled message target: Core 1. */
+#define CMT_SM_CORE1 0x02
+/** @brief Scheduled message target: Both cores. */
+#define CMT_SM_CORES (CMT_SM_CORE0 | CMT_SM_CORE1)
+
 /**
  * @brief Message data.
  *
@@ -56,22 +120,50 @@ typedef union _MSG_DATA_VALUE {
     bool debug;
     uint32_t ts_ms;
     uint64_t ts_us;
-    _cmt_sleep_data_t* cmt_sleep;
+    _cmt_sleep_data_t cmt_sleep;
     char* str;
     int32_t status;
+    uint32_t payload;               // Payload handle (see msg_payload.h)
 } msg_data_value_t;
 
+/**
+ * @brief Message priority class.
+ * @ingroup cmt
+ *
+ * A message loop takes urgent messages first and bulk messages last. Bulk messages are
+ * still taken after a limited number of other messages have gone ahead of them.
+ * Normal is 0, so a message that doesn't set a priority is normal.
+ */
+typedef enum _CMT_MSG_PRIO_ {
+    CMT_MSG_PRIO_NORMAL = 0,
+    CMT_MSG_PRIO_URGENT,
+    CMT_MSG_PRIO_BULK,
+} cmt_msg_prio_t;
+
+/** @brief Message flag: `data.payload` is a payload handle (released after the message is handled). */
+#define CMT_MSG_F_PAYLOAD 0x01
+/** @brief Message flag: stands in for the pending value of a coalescible message ID (set by the posting system). */
+#define CMT_MSG_F_COALESCED 0x02
+
 /**
  * @brief Structure containing a message ID and message data.
  *
  * @param id The ID (number) of the message.
+ * @param prio The priority class of the message (a `cmt_msg_prio_t`).
+ * @param flags Message flags (CMT_MSG_F_...).
  * @param data The data for the message.
- * @param t The millisecond time msg was posted (set by the posting system)
+ * @param t The time msg was posted, low 32 bits of the microsecond time (set by the posting system)
+ * @param deadline Optional deadline (low 32 bits of the microsecond time) for the message to be
+ *        handled by, or 0 for none. Within a priority class, the message with the earliest deadline
+ *        is taken first. Use `cmt_msg_deadline_set` to set it.
  */
 typedef struct _CMT_MSG {
     msg_id_t id;
+    uint8_t prio;
+    uint8_t flags;
     msg_data_value_t data;
     uint32_t t;
+    uint32_t deadline;
 } cmt_msg_t;
 
 
@@ -88,6 +180,10 @@ typedef struct _CMT_MSG {
 #define postUIMsgNoWait( pmsg )         post_to_core1_nowait( pmsg )
 #define postBothMsgBlocking( pmsg )     post_to_cores_blocking( pmsg )
 #define postBothMsgNoWait( pmsg )       post_to_cores_nowait( pmsg )
+#define postBEMsgBatchBlocking( pmsgs, n )  post_to_core0_batch_blocking( pmsgs, n )
+#define postBEMsgBatchNoWait( pmsgs, n )    post_to_core0_batch_nowait( pmsgs, n )
+#define postUIMsgBatchBlocking( pmsgs, n )  post_to_core1_batch_blocking( pmsgs, n )
+#define postUIMsgBatchNoWait( pmsgs, n )    post_to_core1_batch_nowait( pmsgs, n )
 
 /**
  * @brief Function prototype for an idle function.
@@ -109,22 +205,75 @@ typedef struct _MSG_HANDLER_ENTRY {
     msg_handler_fn msg_handler;
 } msg_handler_entry_t;
 
+/**
+ * @brief An idle task of a message loop.
+ * @ingroup cmt
+ *
+ * When a loop has no messages it runs the idle tasks that are due, one at a time (checking
+ * for messages in between). A task is due when `interval_us` has passed since it last started,
+ * and runs at most once per idle pass. A task with an interval of 0 runs every idle pass, and
+ * keeps the loop from sleeping (it is always due). When no task is due, the loop sleeps until one
+ * is (or a message is posted).
+ *
+ * A task that runs longer than its budget is counted as an overrun (see `cmt_idle_usage_sec`).
+ * A task doing work in pieces can use `cmt_idle_time_left_us` to keep within its budget.
+ */
+typedef struct _IDLE_TASK_ENTRY {
+    idle_fn idle;
+    uint32_t interval_us;                           // Minimum time from the start of one run to the next
+    uint32_t budget_us;                             // Time a run should take at most (0 = no budget)
+} idle_task_entry_t;
+
+/**
+ * @brief Process status of a core's message loop (for a one second period).
+ * @ingroup cmt
+ *
+ * The times are in microseconds.
+ */
 typedef struct _PROC_STATUS_ACCUM_ {
-    volatile int64_t cs;
-    volatile uint32_t ts_psa;                               // Timestamp of last PS Accumulator/sec update
-    volatile uint32_t t_active;
-    volatile uint32_t t_idle;
-    volatile uint32_t t_msgr;
-    volatile uint16_t retrived;
-    volatile uint16_t idle;
+    volatile uint32_t ts_psa;                               // Timestamp (us) of last PS Accumulator/sec update
+    volatile uint32_t t_active;                             // Time spent in message handlers
+    volatile uint32_t t_idle;                               // Time spent in idle functions
+    volatile uint32_t t_msgr;                               // Time spent getting messages (including empty checks and publishing the status)
+    volatile uint32_t t_sleep;                              // Time spent asleep (WFE) waiting for work
+    volatile uint32_t retrived;                             // Messages retrieved
+    volatile uint32_t idle;                                 // Times the loop found no message
     volatile uint32_t int_status;
     volatile float core_temp;
 } proc_status_accum_t;
 
+/**
+ * @brief CPU use of a message handler or an idle task (for a one second period).
+ * @ingroup cmt
+ *
+ * @param handler The message handler (NULL for an idle task).
+ * @param idle The idle task's function (NULL for a message handler).
+ * @param msg_id The message ID the handler is for (-1 for an idle task).
+ * @param calls The number of times it was called.
+ * @param t_us The total time (us) it ran.
+ * @param overruns The number of runs that took longer than the idle task's budget (0 for a handler).
+ */
+typedef struct _cmt_fn_usage_ {
+    msg_handler_fn handler;
+    idle_fn idle;
+    int msg_id;
+    uint32_t calls;
+    uint32_t t_us;
+    uint32_t overruns;
+} cmt_fn_usage_t;
+
+/**
+ * @brief Message loop context.
+ *
+ * The handler entries are turned into a dispatch table (indexed by message ID) once, when
+ * the loop is entered, so the number of handlers doesn't affect the cost of dispatching a
+ * message. When more than one handler is registered for a message, they are called in
+ * the order they appear in the list.
+ */
 typedef struct _MSG_LOOP_CNTX {
     uint8_t corenum;                                // The core number the loop is running on
     const msg_handler_entry_t** handler_entries;    // NULL terminated list of message handler entries
-    const idle_fn* idle_functions;                  // Null terminated list of idle functions
+    const idle_task_entry_t** idle_tasks;           // NULL terminated list of idle task entries
 } msg_loop_cntx_t;
 
 /**
@@ -154,6 +303,15 @@ extern bool cmt_message_loop_1_running();
  */
 extern bool cmt_message_loops_running();
 
+/**
+ * @brief Set the deadline of a message.
+ * @ingroup cmt
+ *
+ * @param msg The message to set the deadline of.
+ * @param us The time in microseconds from now that the message should be handled by.
+ */
+extern void cmt_msg_deadline_set(cmt_msg_t* msg, uint32_t us);
+
 /**
  * @brief Handle a Scheduled Message timer Tick.
  *
@@ -164,11 +322,115 @@ extern void cmt_handle_sleep(cmt_msg_t* msg);
 /**
  * @brief Get the last Process Status Accumulator per second values.
  *
+ * The values are a consistent snapshot (they are published by the core's message loop
+ * once a second, under a sequence lock).
+ *
  * @param psas Pointer to Process Status Accumulator structure to fill with values.
  * @param corenum The core number (0|1) to get the process status values for.
  */
 extern void cmt_proc_status_sec(proc_status_accum_t* psas, uint8_t corenum);
 
+/**
+ * @brief Get the CPU use of each of a core's message handlers for the last second.
+ * @ingroup cmt
+ *
+ * The entries are in dispatch order (grouped by message ID), followed by the core-agnostic
+ * handlers (`cmt_shared_handlers_set`) with their use on this core.
+ *
+ * @param corenum The core number (0|1).
+ * @param usage Array to fill with the values.
+ * @param max The number of entries in the array.
+ * @return The number of entries filled in.
+ */
+extern int cmt_handler_usage_sec(uint8_t corenum, cmt_fn_usage_t* usage, int max);
+
+/**
+ * @brief Get the CPU use of each of a core's idle tasks for the last second.
+ * @ingroup cmt
+ *
+ * The entries are in the order of the core's idle task list.
+ *
+ * @param corenum The core number (0|1).
+ * @param usage Array to fill with the values.
+ * @param max The number of entries in the array.
+ * @return The number of entries filled in.
+ */
+extern int cmt_idle_usage_sec(uint8_t corenum, cmt_fn_usage_t* usage, int max);
+
+/**
+ * @brief The time left in the budget of the idle task that is running.
+ * @ingroup cmt
+ *
+ * For an idle task that does its work in pieces, to know when to stop.
+ *
+ * @return The time (us) left (0 if the budget is used up), or UINT32_MAX if the running
+ *         idle task has no budget or an idle task isn't running on the calling core.
+ */
+extern uint32_t cmt_idle_time_left_us(void);
+
+/**
+ * @brief Number of buckets in a message statistics histogram.
+ * @ingroup cmt
+ *
+ * Bucket 0 counts times under 1us, bucket `b` counts times from 2^(b-1) up to 2^b us,
+ * and the last bucket counts everything longer than that.
+ */
+#define CMT_MSG_HIST_BUCKETS 20
+
+/**
+ * @brief Statistics for a message ID on a core.
+ * @ingroup cmt
+ *
+ * @param count Number of messages with the ID handled.
+ * @param queue_max_us Longest time (us) a message spent in the queue.
+ * @param handler_max_us Longest time (us) the handler(s) took for a message.
+ * @param queue_hist Log2 histogram of the time messages spent in the queue (posted to taken).
+ * @param handler_hist Log2 histogram of the time the handler(s) took.
+ */
+typedef struct _cmt_msg_stats_ {
+    uint32_t count;
+    uint32_t queue_max_us;
+    uint32_t handler_max_us;
+    uint32_t queue_hist[CMT_MSG_HIST_BUCKETS];
+    uint32_t handler_hist[CMT_MSG_HIST_BUCKETS];
+} cmt_msg_stats_t;
+
+/**
+ * @brief Get the statistics (queue time and handler time) for a message ID on a core.
+ * @ingroup cmt
+ *
+ * This can be called from either core (but not from an interrupt handler). The values
+ * are a consistent snapshot.
+ *
+ * @param corenum The core number (0|1) that handles the messages.
+ * @param id The message ID.
+ * @param stats Pointer to a statistics structure to fill with the values.
+ * @return true The ID is valid and the statistics were filled in.
+ * @return false The core number or ID isn't valid (or statistics aren't built in).
+ */
+extern bool cmt_msg_stats(uint8_t corenum, msg_id_t id, cmt_msg_stats_t* stats);
+
+/**
+ * @brief Print the statistics of the message IDs a core has handled.
+ * @ingroup cmt
+ *
+ * Each ID with a count is printed with its maximum times and the non-empty buckets
+ * of its histograms (as `<lo>-<hi>us:count`).
+ *
+ * @param corenum The core number (0|1) to print the statistics of.
+ */
+extern void cmt_msg_stats_print(uint8_t corenum);
+
+/**
+ * @brief Reset the message statistics for a core.
+ * @ingroup cmt
+ *
+ * The reset is done by the core's message loop before it takes its next messages.
+ *
+ * @param corenum The core number (0|1) to reset the statistics of.
+ */
+extern void cmt_msg_stats_reset(uint8_t corenum);
+
 /**
  * @brief The number of scheduled messages waiting.
  *
@@ -176,6 +438,18 @@ extern void cmt_proc_status_sec(proc_status_accum_t* psas, uint8_t corenum);
  */
 extern int cmt_sched_msg_waiting();
 
+/**
+ * @brief The number of repeating scheduled message posts to a core that were missed because
+ *        the core was behind (its scheduled message slots were full).
+ * @ingroup cmt
+ *
+ * The alarm interrupt only counts these. The core's message loop reports them (once a second).
+ *
+ * @param corenum The core number (0|1).
+ * @return The number missed since startup.
+ */
+extern uint32_t cmt_sched_msg_missed(uint8_t corenum);
+
 /**
  * @brief Sleep for milliseconds and call a function.
  * @ingroup cmt
@@ -183,16 +457,154 @@ extern int cmt_sched_msg_waiting();
  * @param ms The time in milliseconds from now.
  * @param sleep_fn The function to call when the time expires.
  * @param user_data A pointer to user data that the 'sleep_fn' will be called with.
+ * @return Handle for the scheduled sleep, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
  */
-extern void cmt_sleep_ms(int32_t ms, cmt_sleep_fn sleep_fn, void* user_data);
+extern cmt_sm_handle_t cmt_sleep_ms(int32_t ms, cmt_sleep_fn sleep_fn, void* user_data);
 
 /**
  * @brief Schedule a message to post in the future.
  *
+ * The message is posted to the calling core. (Use `schedule_core_msg_in_ms` to post it to
+ * the other core, or both.) The message is copied, so it doesn't need to remain valid after the call.
+ * A message with a payload can't be scheduled (the copy would share the payload's reference).
+ *
  * @param ms The time in milliseconds from now.
  * @param msg The cmt_msg_t message to post when the time period elapses.
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
+ */
+extern cmt_sm_handle_t schedule_msg_in_ms(int32_t ms, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to post in the future, with microsecond resolution.
+ * @ingroup cmt
+ *
+ * The deadline is stored as an absolute time, and a single hardware alarm is armed
+ * for the earliest waiting deadline, so there is no accumulated drift and no timer
+ * activity while nothing is scheduled.
+ *
+ * @param us The time in microseconds from now. A value <= 0 posts the message as soon as possible.
+ * @param msg The cmt_msg_t message to post when the time period elapses (copied).
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
+ */
+extern cmt_sm_handle_t schedule_msg_in_us(int64_t us, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to post repeatedly, every `period_ms` milliseconds.
+ * @ingroup cmt
+ *
+ * The message is posted on a fixed phase grid. Each deadline is computed from the previous
+ * deadline (not from when the message was handled), so handler and dispatch latency don't
+ * accumulate. If periods go by without the message being posted (the alarm was serviced late,
+ * or the target core had no free scheduled message slot) they are counted as missed, and the
+ * message picks up again on the grid.
+ *
+ * The repeating message stays scheduled (and keeps its handle) until it is cancelled.
+ *
+ * @param period_ms The period in milliseconds. The first post is one period from now.
+ * @param msg The cmt_msg_t message to post each period (copied).
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
+ */
+extern cmt_sm_handle_t schedule_msg_every_ms(int32_t period_ms, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to post repeatedly, every `period_us` microseconds.
+ * @ingroup cmt
+ *
+ * @see schedule_msg_every_ms()
+ *
+ * @param period_us The period in microseconds. The first post is one period from now.
+ * @param msg The cmt_msg_t message to post each period (copied).
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
+ */
+extern cmt_sm_handle_t schedule_msg_every_us(int64_t period_us, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to post to specific core(s) in the future.
+ * @ingroup cmt
+ *
+ * The scheduling calls can be used from either core, and from interrupt handlers. When a message
+ * is due it is posted by the scheduled message alarm interrupt into a ring for each core that
+ * only it posts to. A slot in that ring is reserved for a one-shot message when it is scheduled,
+ * so the post can't fail, wait, or print in the interrupt. (If no slot can be reserved, because
+ * the core has fallen behind, the message isn't scheduled.)
+ *
+ * @param cores The core(s) to post the message to (CMT_SM_CORE0, CMT_SM_CORE1, or CMT_SM_CORES).
+ * @param ms The time in milliseconds from now.
+ * @param msg The cmt_msg_t message to post when the time period elapses (copied).
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
+ */
+extern cmt_sm_handle_t schedule_core_msg_in_ms(uint8_t cores, int32_t ms, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to post to specific core(s) in the future, with microsecond resolution.
+ * @ingroup cmt
+ *
+ * @see schedule_core_msg_in_ms()
+ * @see schedule_msg_in_us()
+ *
+ * @param cores The core(s) to post the message to (CMT_SM_CORE0, CMT_SM_CORE1, or CMT_SM_CORES).
+ * @param us The time in microseconds from now. A value <= 0 posts the message as soon as possible.
+ * @param msg The cmt_msg_t message to post when the time period elapses (copied).
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
+ */
+extern cmt_sm_handle_t schedule_core_msg_in_us(uint8_t cores, int64_t us, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to post to specific core(s) repeatedly, every `period_ms` milliseconds.
+ * @ingroup cmt
+ *
+ * A repeating message doesn't reserve slots. A period is posted to a core only if it has a
+ * slot that isn't reserved, otherwise it is counted as missed (for the message, and for the
+ * core in `cmt_sched_msg_missed`).
+ *
+ * @see schedule_msg_every_ms()
+ *
+ * @param cores The core(s) to post the message to (CMT_SM_CORE0, CMT_SM_CORE1, or CMT_SM_CORES).
+ * @param period_ms The period in milliseconds. The first post is one period from now.
+ * @param msg The cmt_msg_t message to post each period (copied).
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
  */
-extern void schedule_msg_in_ms(int32_t ms, cmt_msg_t* msg);
+extern cmt_sm_handle_t schedule_core_msg_every_ms(uint8_t cores, int32_t period_ms, const cmt_msg_t* msg);
+
+/**
+ * @brief Schedule a message to post to specific core(s) repeatedly, every `period_us` microseconds.
+ * @ingroup cmt
+ *
+ * @see schedule_core_msg_every_ms()
+ *
+ * @param cores The core(s) to post the message to (CMT_SM_CORE0, CMT_SM_CORE1, or CMT_SM_CORES).
+ * @param period_us The period in microseconds. The first post is one period from now.
+ * @param msg The cmt_msg_t message to post each period (copied).
+ * @return Handle for the scheduled message, or CMT_SM_HANDLE_INVALID if it couldn't be scheduled.
+ */
+extern cmt_sm_handle_t schedule_core_msg_every_us(uint8_t cores, int64_t period_us, const cmt_msg_t* msg);
+
+/**
+ * @brief Get the number of periods a repeating scheduled message has missed.
+ * @ingroup cmt
+ *
+ * @param handle The handle returned when the message was scheduled.
+ * @return The number of missed periods (0 if the handle isn't for a pending message).
+ */
+extern uint32_t scheduled_msg_handle_missed(cmt_sm_handle_t handle);
+
+/**
+ * @brief Cancel a specific scheduled message.
+ * @ingroup cmt
+ *
+ * @param handle The handle returned when the message was scheduled.
+ * @return true if the message was cancelled. false if it was already posted (or cancelled).
+ */
+extern bool scheduled_msg_handle_cancel(cmt_sm_handle_t handle);
+
+/**
+ * @brief Check if a specific scheduled message is still waiting to be posted.
+ * @ingroup cmt
+ *
+ * @param handle The handle returned when the message was scheduled.
+ * @return true if the message is still waiting.
+ */
+extern bool scheduled_msg_handle_pending(cmt_sm_handle_t handle);
 
 /**
  * @brief Cancel scheduled message(s) for a message ID.
@@ -201,6 +613,9 @@ extern void schedule_msg_in_ms(int32_t ms, cmt_msg_t* msg);
  * This will attempt to cancel the scheduled message. It is possible that the time might have already
  * past and the message was posted.
  *
+ * This cancels every scheduled message with the ID. Use `scheduled_msg_handle_cancel` to cancel
+ * a single one.
+ *
  * @param sched_msg_id The ID of the message that was scheduled.
  */
 extern void scheduled_msg_cancel(msg_id_t sched_msg_id);
@@ -223,10 +638,47 @@ extern bool scheduled_message_exists(msg_id_t sched_msg_id);
  * Enter into a message processing loop using a loop context.
  * This function will not return.
  *
+ * When there are no messages, a message from the shared work queue is handled (see
+ * `cmt_shared_handlers_set`). When there are none of those either, the idle functions are run
+ * (one per pass). Once they have all had a turn, the loop sleeps (WFE) until a message is posted,
+ * an interrupt occurs, or `CMT_IDLE_SLEEP_MAX_US` passes. The time asleep is reported as `t_sleep`.
+ *
  * @param loop_context Loop context for processing.
  */
 extern void message_loop(const msg_loop_cntx_t* loop_context);
 
+/**
+ * @brief Set the core-agnostic message handlers (for the shared work queue).
+ * @ingroup cmt
+ *
+ * The messages posted with `post_shared_...` are handled by these handlers, by whichever
+ * core's message loop takes them: a core takes them when its own queue is empty, and also
+ * between its own messages when the shared queue is at least half full. So the handlers must
+ * be able to run on either core (and on both at once, for different message IDs).
+ *
+ * Must be called before the message loops are started.
+ *
+ * @param handler_entries NULL terminated list of message handler entries.
+ * @return true The handlers were set.
+ * @return false A message loop is running (the handlers were not changed).
+ */
+extern bool cmt_shared_handlers_set(const msg_handler_entry_t** handler_entries);
+
+/**
+ * @brief Handle a message from the shared work queue on the calling core (if there is one
+ *        that can be handled).
+ * @ingroup cmt
+ *
+ * Used by a blocking shared post that is waiting for room, so that a message loop that posts
+ * shared work helps to drain the queue rather than just waiting (two cores waiting on a full
+ * queue would never get room). Does nothing in an interrupt handler, or on a core that isn't
+ * running its message loop. The time is charged to the shared handler, and left out of the
+ * time of the handler (coroutine or idle task) that was waiting.
+ *
+ * @return true if a message was handled.
+ */
+extern bool cmt_shared_help(void);
+
 /**
  * @brief Initialize the Cooperative Multi-Tasking system.
  * @ingroup cmt
@@ -0,0 +1,191 @@
+/**
+ * CMT Coroutines.
+ *
+ * Stackless (protothread style) coroutines that run in a core's message loop.
+ *
+ * See the cmt_co.h header for important information.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "cmt_co.h"
+#include "hardware/timer.h"
+#include "pico/stdlib.h"
+
+#include <string.h>
+
+#define _CO_IDS_WORDS ((CMT_MSG_ID_CNT + 31) / 32)
+
+// Only the core's own message loop (or code it calls) uses its coroutines, so no lock is needed.
+static cmt_co_t* _co_active[2];                     // Active coroutines (list) for each core
+static uint32_t _co_ids[2][_CO_IDS_WORDS];          // IDs being waited for (bit per dense ID index)
+static bool _co_timed[2];                           // A coroutine is waiting for a time
+static uint32_t _co_next_wake[2];                   // Earliest time a wait ends
+
+/**
+ * @brief Recalculate the IDs being waited for and the earliest wait time for a core.
+ */
+static void _co_index_update(uint8_t corenum) {
+    memset(_co_ids[corenum], 0, sizeof(_co_ids[corenum]));
+    bool timed = false;
+    uint32_t next_wake = 0;
+    for (cmt_co_t* co = _co_active[corenum]; co; co = co->next) {
+        for (int i = 0; i < co->id_cnt; i++) {
+            int index = cmt_msg_id_index(co->ids[i]);
+            if (index >= 0) {
+                _co_ids[corenum][index >> 5] |= (1u << (index & 31));
+            }
+        }
+        if (co->timed && (!timed || (int32_t)(co->wake_us - next_wake) < 0)) {
+            next_wake = co->wake_us;
+            timed = true;
+        }
+    }
+    _co_next_wake[corenum] = next_wake;
+    _co_timed[corenum] = timed;
+}
+
+static void _co_remove(cmt_co_t* co) {
+    cmt_co_t** cop = &_co_active[co->corenum];
+    while (*cop) {
+        if (*cop == co) {
+            *cop = co->next;
+            break;
+        }
+        cop = &(*cop)->next;
+    }
+    co->active = false;
+    co->next = NULL;
+}
+
+/**
+ * @brief Run a coroutine (from where it waited) until it waits again or ends.
+ */
+static void _co_resume(cmt_co_t* co) {
+    co->ready = false;
+    co->timed = false;
+    co->id_cnt = 0;
+    if (CMT_CO_ENDED == co->fn(co) && co->active) {
+        _co_remove(co);
+    }
+}
+
+/**
+ * @brief Run the coroutines of a core that are ready.
+ *
+ * A coroutine that runs can start or stop others, so the list is checked from the
+ * start again after each one.
+ */
+static void _co_run_ready(uint8_t corenum) {
+    bool ran = true;
+    while (ran) {
+        ran = false;
+        for (cmt_co_t* co = _co_active[corenum]; co; co = co->next) {
+            if (co->ready) {
+                _co_resume(co);
+                ran = true;
+                break;
+            }
+        }
+    }
+    _co_index_update(corenum);
+}
+
+/**
+ * @brief Check that a coroutine isn't active on the other core.
+ *
+ * The other core walks its list without a lock, so it can't be removed from here.
+ */
+static void _co_core_check(const cmt_co_t* co, uint8_t corenum) {
+    if (co->active && co->corenum != corenum) {
+        panic("CMT CO - Coroutine is running on core %d (can't restart/stop it from core %d).", co->corenum, corenum);
+    }
+}
+
+void cmt_co_start(cmt_co_t* co, cmt_co_fn fn, void* data) {
+    uint8_t corenum = (uint8_t)get_core_num();
+    _co_core_check(co, corenum);
+    if (co->active) {
+        _co_remove(co);
+    }
+    co->lc = 0;
+    co->corenum = corenum;
+    co->ready = false;
+    co->timed = false;
+    co->timed_out = false;
+    co->id_cnt = 0;
+    co->fn = fn;
+    co->data = data;
+    co->active = true;
+    co->next = _co_active[corenum];
+    _co_active[corenum] = co;
+    _co_resume(co);
+    _co_index_update(corenum);
+}
+
+void cmt_co_stop(cmt_co_t* co) {
+    _co_core_check(co, (uint8_t)get_core_num());
+    if (co->active) {
+        _co_remove(co);
+        _co_index_update(co->corenum);
+    }
+}
+
+bool cmt_co_running(const cmt_co_t* co) {
+    return (co->active);
+}
+
+void cmt_co_wait_set(cmt_co_t* co, int32_t ms, const msg_id_t* ids, uint8_t id_cnt) {
+    co->timed_out = false;
+    co->timed = (ms >= 0);
+    if (co->timed) {
+        co->wake_us = time_us_32() + ((uint32_t)ms * 1000);
+    }
+    if (id_cnt > CMT_CO_WAIT_IDS_MAX) {
+        panic("CMT CO - Too many message IDs to wait for (max: %d).", CMT_CO_WAIT_IDS_MAX);
+    }
+    co->id_cnt = id_cnt;
+    for (int i = 0; i < id_cnt; i++) {
+        co->ids[i] = ids[i];
+    }
+}
+
+bool cmt_co_timers_run(uint8_t corenum, uint32_t now) {
+    if (!_co_timed[corenum] || (int32_t)(now - _co_next_wake[corenum]) < 0) {
+        return (false);
+    }
+    for (cmt_co_t* co = _co_active[corenum]; co; co = co->next) {
+        if (co->timed && (int32_t)(now - co->wake_us) >= 0) {
+            co->timed_out = true;
+            co->ready = true;
+        }
+    }
+    _co_run_ready(corenum);
+    return (true);
+}
+
+bool cmt_co_msg_deliver(uint8_t corenum, const cmt_msg_t* msg, int index) {
+    if (!(_co_ids[corenum][index >> 5] & (1u << (index & 31)))) {
+        return (false);
+    }
+    for (cmt_co_t* co = _co_active[corenum]; co; co = co->next) {
+        for (int i = 0; i < co->id_cnt; i++) {
+            if (co->ids[i] == msg->id) {
+                co->msg = *msg;
+                co->ready = true;
+                break;
+            }
+        }
+    }
+    _co_run_ready(corenum);
+    return (true);
+}
+
+uint32_t cmt_co_wait_us(uint8_t corenum, uint32_t now) {
+    if (!_co_timed[corenum]) {
+        return (UINT32_MAX);
+    }
+    int32_t wait = (int32_t)(_co_next_wake[corenum] - now);
+    return (wait > 0 ? (uint32_t)wait : 0);
+}
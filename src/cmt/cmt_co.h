@@ -0,0 +1,249 @@
+/**
+ * CMT Coroutines.
+ *
+ * Stackless (protothread style) coroutines that run in a core's message loop.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _MK_CMT_CO_H_
+#define _MK_CMT_CO_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cmt.h"
+
+/**
+ * @file cmt_co.h
+ * @defgroup mk_cmt_co mk_cmt_co
+ * Stackless coroutines for the message loops.
+ *
+ * A coroutine is a function that can wait (for a time to pass, or for a message) part way
+ * through, and continue from that point when the wait is over. This lets a sequence of timed
+ * steps be written as linear code, rather than as a chain of `cmt_sleep_ms` continuations.
+ * The waits don't use a scheduled message or a queue entry. The message loop of the core that
+ * started the coroutine checks its timers each time through the loop, and hands it the messages
+ * it is waiting for after their handlers have run.
+ *
+ * The coroutines are stackless. The function returns at each wait, and is called again (and
+ * jumps back to the wait) when the wait is over. Because of that:
+ *  - Local variables don't keep their values across a wait, so use `static` ones (or `data`).
+ *  - A wait can't be in a function called by the coroutine, only in the coroutine itself.
+ *  - There can only be one wait on a source line, and waits can't be in a `switch`.
+ *
+ * Example:
+ * @code
+ * static cmt_co_t _blink_co;
+ * static cmt_co_result_t _blink(cmt_co_t* co) {
+ *     static int i;
+ *     CMT_CO_BEGIN(co);
+ *     for (i = 0; i < 3; i++) {
+ *         led_on(true);
+ *         CMT_CO_AWAIT_SLEEP(co, 100);
+ *         led_on(false);
+ *         CMT_CO_AWAIT_SLEEP(co, 100);
+ *     }
+ *     CMT_CO_END(co);
+ * }
+ * ...
+ * cmt_co_start(&_blink_co, _blink, NULL);
+ * @endcode
+ *
+ * A coroutine belongs to the core that starts it, and must only be started and stopped
+ * from that core (not from an interrupt handler). Restarting or stopping it from the other
+ * core while it runs panics. To restart it from either core, have its core do it (for
+ * example with a `MSG_CMT_SLEEP` message scheduled for that core).
+ *
+ * @addtogroup mk_cmt_co
+ * @include cmt_co.c
+ *
+*/
+
+#ifndef CMT_CO_WAIT_IDS_MAX
+#define CMT_CO_WAIT_IDS_MAX 4   // Max message IDs a coroutine can wait for at once
+#endif
+
+/**
+ * @brief Result of running a coroutine (returned by the CMT_CO_ macros).
+ * @ingroup mk_cmt_co
+ */
+typedef enum _cmt_co_result_ {
+    CMT_CO_WAITING = 0,
+    CMT_CO_ENDED,
+} cmt_co_result_t;
+
+typedef struct _cmt_co_ cmt_co_t;
+
+/**
+ * @brief Function prototype for a coroutine.
+ * @ingroup mk_cmt_co
+ *
+ * The body must be between `CMT_CO_BEGIN` and `CMT_CO_END`.
+ *
+ * @param co The coroutine's state.
+ * @return The macros return the result.
+ */
+typedef cmt_co_result_t (*cmt_co_fn)(cmt_co_t* co);
+
+/**
+ * @brief Coroutine state. Define one (statically) for each coroutine.
+ * @ingroup mk_cmt_co
+ *
+ * `data`, `msg` and `timed_out` are for the coroutine to use. The rest is managed by CMT.
+ */
+struct _cmt_co_ {
+    uint16_t lc;                        // Line to continue from (0 = the beginning)
+    uint8_t corenum;                    // Core the coroutine runs on
+    bool active;
+    bool ready;                         // Wait is over, to be run
+    bool timed;                         // Waiting for `wake_us`
+    bool timed_out;                     // The last wait ended with the time passing (rather than a message)
+    uint8_t id_cnt;                     // Number of message IDs being waited for
+    msg_id_t ids[CMT_CO_WAIT_IDS_MAX];
+    uint32_t wake_us;                   // Time (`time_us_32`) to end the wait
+    cmt_co_fn fn;
+    void* data;                         // User data (from `cmt_co_start`)
+    cmt_msg_t msg;                      // The message that ended the last wait
+    cmt_co_t* next;                     // Next active coroutine on the core
+};
+
+/**
+ * @brief Start of the body of a coroutine.
+ * @ingroup mk_cmt_co
+ */
+#define CMT_CO_BEGIN(co) switch ((co)->lc) { case 0:
+
+/**
+ * @brief End of the body of a coroutine. The coroutine has finished.
+ * @ingroup mk_cmt_co
+ */
+#define CMT_CO_END(co) } (co)->lc = 0; return (CMT_CO_ENDED)
+
+/**
+ * @brief Finish a coroutine before reaching its end.
+ * @ingroup mk_cmt_co
+ */
+#define CMT_CO_EXIT(co) do { (co)->lc = 0; return (CMT_CO_ENDED); } while (0)
+
+#define _CMT_CO_WAIT(co) (co)->lc = __LINE__; return (CMT_CO_WAITING); case __LINE__:
+
+/**
+ * @brief Wait for a time (milliseconds) to pass.
+ * @ingroup mk_cmt_co
+ *
+ * @param co The coroutine's state.
+ * @param ms The time to wait (up to 2,000,000 ms).
+ */
+#define CMT_CO_AWAIT_SLEEP(co, ms) do { cmt_co_wait_set((co), (ms), NULL, 0); _CMT_CO_WAIT(co) } while (0)
+
+/**
+ * @brief Wait for a message with an ID to be received by the core's message loop.
+ * @ingroup mk_cmt_co
+ *
+ * The message is in `co->msg` when the wait is over. (A payload of the message can only be
+ * used until the coroutine waits again.)
+ *
+ * @param co The coroutine's state.
+ * @param id The message ID to wait for.
+ */
+#define CMT_CO_AWAIT_MSG(co, id) \
+    do { const msg_id_t _ids[] = { (id) }; cmt_co_wait_set((co), -1, _ids, 1); _CMT_CO_WAIT(co) } while (0)
+
+/**
+ * @brief Wait for a message with any of a set of IDs, or for a time to pass.
+ * @ingroup mk_cmt_co
+ *
+ * When the wait is over, `co->timed_out` is true if the time passed, otherwise the message
+ * is in `co->msg`.
+ *
+ * @param co The coroutine's state.
+ * @param ms The longest time to wait (up to 2,000,000 ms), or -1 to wait only for a message.
+ * @param ... The message IDs to wait for (up to CMT_CO_WAIT_IDS_MAX).
+ */
+#define CMT_CO_AWAIT_ANY(co, ms, ...) \
+    do { const msg_id_t _ids[] = { __VA_ARGS__ }; \
+        cmt_co_wait_set((co), (ms), _ids, (uint8_t)(sizeof(_ids) / sizeof(_ids[0]))); _CMT_CO_WAIT(co) } while (0)
+
+/**
+ * @brief Start (or restart) a coroutine on the calling core.
+ * @ingroup mk_cmt_co
+ *
+ * The coroutine runs right away, up to its first wait. If it is already running it is
+ * started again from the beginning. It panics if it is running on the other core.
+ *
+ * @param co The coroutine's state.
+ * @param fn The coroutine function.
+ * @param data User data for the coroutine (`co->data`).
+ */
+extern void cmt_co_start(cmt_co_t* co, cmt_co_fn fn, void* data);
+
+/**
+ * @brief Stop a coroutine (that is waiting).
+ * @ingroup mk_cmt_co
+ *
+ * It panics if the coroutine is running on the other core.
+ *
+ * @param co The coroutine's state.
+ */
+extern void cmt_co_stop(cmt_co_t* co);
+
+/**
+ * @brief Indicates if a coroutine is running (started, and hasn't ended or been stopped).
+ * @ingroup mk_cmt_co
+ *
+ * @param co The coroutine's state.
+ * @return true The coroutine is running.
+ * @return false The coroutine isn't running.
+ */
+extern bool cmt_co_running(const cmt_co_t* co);
+
+/**
+ * @brief Set what a coroutine is about to wait for (used by the CMT_CO_AWAIT_ macros).
+ * @ingroup mk_cmt_co
+ *
+ * @param co The coroutine's state.
+ * @param ms The time to wait, or -1 for no time limit.
+ * @param ids The message IDs to wait for (NULL if none).
+ * @param id_cnt The number of message IDs.
+ */
+extern void cmt_co_wait_set(cmt_co_t* co, int32_t ms, const msg_id_t* ids, uint8_t id_cnt);
+
+// Used by the message loop...
+
+/**
+ * @brief Run the coroutines of a core whose wait time has passed.
+ * @ingroup mk_cmt_co
+ *
+ * @param corenum The core number (0|1) of the calling message loop.
+ * @param now The current time (`time_us_32`).
+ * @return true if a coroutine's wait time had passed (and it was run).
+ */
+extern bool cmt_co_timers_run(uint8_t corenum, uint32_t now);
+
+/**
+ * @brief Give a message received by a core's message loop to the coroutines waiting for it.
+ * @ingroup mk_cmt_co
+ *
+ * @param corenum The core number (0|1) of the calling message loop.
+ * @param msg The message (after its handlers have run).
+ * @param index The message ID's dense index (`cmt_msg_id_index`).
+ * @return true if a coroutine was waiting for the message (and was run).
+ */
+extern bool cmt_co_msg_deliver(uint8_t corenum, const cmt_msg_t* msg, int index);
+
+/**
+ * @brief The time until the next coroutine wait time of a core ends.
+ * @ingroup mk_cmt_co
+ *
+ * @param corenum The core number (0|1).
+ * @param now The current time (`time_us_32`).
+ * @return The time (us), or UINT32_MAX if no coroutine of the core is waiting for a time.
+ */
+extern uint32_t cmt_co_wait_us(uint8_t corenum, uint32_t now);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _MK_CMT_CO_H_
@@ -0,0 +1,61 @@
+/**
+ * CMT Event Trace.
+ *
+ * A binary trace of the message runtime (and drivers) for each core, that can be dumped
+ * over stdio and turned into a timeline.
+ *
+ * See the cmt_trace.h header for important information.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "cmt_trace.h"
+#include "hardware/sync.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static_assert((CMT_TRACE_DEPTH & (CMT_TRACE_DEPTH - 1)) == 0, "CMT_TRACE_DEPTH must be a power of 2");
+static_assert(sizeof(cmt_trace_event_t) == 8, "cmt_trace_event_t must be 8 bytes");
+
+#if CMT_TRACE
+cmt_trace_ring_t cmt_trace_rings[CMT_TRACE_RINGS];
+#endif
+volatile bool cmt_trace_on = (CMT_TRACE != 0);
+
+void cmt_trace_clear(void) {
+#if CMT_TRACE
+    memset(cmt_trace_rings, 0, sizeof(cmt_trace_rings));
+#endif
+}
+
+void cmt_trace_dump(void) {
+    bool was_on = cmt_trace_enable(false);
+    // Make the change visible to the other core. An event it was recording when tracing was
+    // turned off may still be partly written (the dump doesn't wait for it).
+    __dmb();
+#if CMT_TRACE
+    printf("\n#CMT-TRACE 2 %d %d\n", CMT_TRACE_RINGS, CMT_TRACE_DEPTH);
+    for (int r = 0; r < CMT_TRACE_RINGS; r++) {
+        const cmt_trace_ring_t* ring = &cmt_trace_rings[r];
+        uint32_t head = ring->head;
+        uint32_t count = (head < CMT_TRACE_DEPTH ? head : CMT_TRACE_DEPTH);
+        printf("@%d %u\n", r, count);
+        for (uint32_t n = head - count; n != head; n++) {
+            const cmt_trace_event_t* event = &ring->events[n & (CMT_TRACE_DEPTH - 1)];
+            printf("%08x%02x%02x%04x\n", event->t, event->type, event->a, event->b);
+        }
+    }
+#else
+    printf("\n#CMT-TRACE 2 0 0\n"); // (not built in)
+#endif
+    printf("#END\n");
+    cmt_trace_enable(was_on);
+}
+
+bool cmt_trace_enable(bool on) {
+    bool was_on = cmt_trace_on;
+    cmt_trace_on = (on && CMT_TRACE);
+    return (was_on);
+}
@@ -0,0 +1,190 @@
+/**
+ * CMT Event Trace.
+ *
+ * A binary trace of the message runtime (and drivers) for each core, that can be dumped
+ * over stdio and turned into a timeline.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _MK_CMT_TRACE_H_
+#define _MK_CMT_TRACE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico/types.h"
+#include "pico/platform.h"
+#include "hardware/timer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file cmt_trace.h
+ * @defgroup mk_cmt_trace mk_cmt_trace
+ * Binary event trace.
+ *
+ * Each core has two trace rings, one for the code it runs and one for its interrupt handlers.
+ * Each ring has a single writer, so recording an event is a few loads and stores (no lock, and
+ * no interrupts disabled). An event is 8 bytes: the time (`time_us_32`), the event type, and
+ * two small values (usually a message ID and a core or index). When a ring is full the oldest
+ * events are overwritten, so the trace holds the most recent events.
+ *
+ * The runtime records message posts (and drops), messages taken from the queue, handler and
+ * idle task runs, and the scheduled message alarm interrupt. The SPI operations record their
+ * transfers (a DMA transfer is recorded when it starts, and when its interrupt finishes it).
+ * Other code can use `cmt_trace` with `CMT_TRACE_MARK` (or the ISR types).
+ *
+ * `cmt_trace_dump` prints the rings (as hex) to stdio. The host tool `cmt_trace_json`
+ * (src/host/tools) turns a dump into Chrome/Perfetto trace JSON, with a process for each core
+ * and a thread for its loop and its interrupts.
+ *
+ * It is not built in by default (the rings take `CMT_TRACE_RINGS * CMT_TRACE_DEPTH * 8` bytes
+ * of RAM, and every post records an event). Set `CMT_TRACE` to 1 to build with it.
+ *
+ * @addtogroup mk_cmt_trace
+ * @include cmt_trace.c
+ *
+*/
+
+#ifndef CMT_TRACE
+#define CMT_TRACE 0                     // Record a trace (1 to build the trace calls in)
+#endif
+
+#ifndef CMT_TRACE_DEPTH
+#define CMT_TRACE_DEPTH 256             // Events in each trace ring (power of 2)
+#endif
+
+#define CMT_TRACE_RINGS 4               // Core 0, Core 0 IRQ, Core 1, Core 1 IRQ
+
+/**
+ * @brief Trace event types.
+ * @ingroup mk_cmt_trace
+ *
+ * The values are part of the dump format (add new ones at the end).
+ */
+typedef enum _cmt_trace_type_ {
+    CMT_TRACE_NONE = 0,
+    CMT_TRACE_POST,                     // a: Destination core (2 = shared work queue), b: Message ID
+    CMT_TRACE_POST_DROP,                // a: Destination core (2 = shared work queue), b: Message ID
+    CMT_TRACE_TAKE,                     // a: Messages in the batch (0 = shared work queue), b: Message ID
+    CMT_TRACE_HANDLER_START,            // a: Handler index, b: Message ID
+    CMT_TRACE_HANDLER_END,              // a: Handler index, b: Message ID
+    CMT_TRACE_IDLE_START,               // a: Idle task index
+    CMT_TRACE_IDLE_END,                 // a: Idle task index
+    CMT_TRACE_ISR_ENTER,                // a: Number (of the source), b: CMT_TRACE_ISR_B(source, detail)
+    CMT_TRACE_ISR_EXIT,                 // a: Number (of the source), b: CMT_TRACE_ISR_B(source, detail)
+    CMT_TRACE_SPI_START,                // a: SPI number, b: Length (bytes, up to 65535)
+    CMT_TRACE_SPI_END,                  // a: SPI number, b: Length (bytes, up to 65535)
+    CMT_TRACE_MARK,                     // a, b: User values
+    CMT_TRACE_SPI_DMA_START,            // a: SPI number, b: Length (bytes, up to 65535)
+    CMT_TRACE_SPI_DMA_END,              // a: SPI number, b: Length (bytes, up to 65535) (from the DMA interrupt)
+} cmt_trace_type_t;
+
+/**
+ * @brief What an interrupt event's number is (kept in the top 4 bits of its `b`).
+ * @ingroup mk_cmt_trace
+ */
+typedef enum _cmt_trace_isr_src_ {
+    CMT_TRACE_ISR_SRC_IRQ = 0,          // IRQ number (for example DMA_IRQ_0)
+    CMT_TRACE_ISR_SRC_ALARM,            // Hardware alarm number
+    CMT_TRACE_ISR_SRC_GPIO,             // GPIO number (detail: the events)
+} cmt_trace_isr_src_t;
+
+/** @brief The `b` of an interrupt event: the source and a 12 bit detail value. */
+#define CMT_TRACE_ISR_B(src, detail) ((uint16_t)(((uint16_t)(src) << 12) | ((detail) & 0x0fff)))
+#define CMT_TRACE_ISR_SRC(b) ((b) >> 12)
+#define CMT_TRACE_ISR_DETAIL(b) ((b) & 0x0fff)
+
+/**
+ * @brief Trace event.
+ * @ingroup mk_cmt_trace
+ */
+typedef struct _cmt_trace_event_ {
+    uint32_t t;                         // Time (`time_us_32`)
+    uint8_t type;                       // cmt_trace_type_t
+    uint8_t a;
+    uint16_t b;
+} cmt_trace_event_t;
+
+/**
+ * @brief Trace ring (one writer).
+ * @ingroup mk_cmt_trace
+ */
+typedef struct _cmt_trace_ring_ {
+    uint32_t head;                      // Events recorded (only changed by the writer)
+    cmt_trace_event_t events[CMT_TRACE_DEPTH];
+} cmt_trace_ring_t;
+
+extern cmt_trace_ring_t cmt_trace_rings[CMT_TRACE_RINGS];
+extern volatile bool cmt_trace_on;
+
+/**
+ * @brief Record a trace event (if tracing is on).
+ * @ingroup mk_cmt_trace
+ *
+ * Can be used from either core, and from interrupt handlers. (An interrupt handler that
+ * interrupts another one on the same core can overwrite an event being recorded.)
+ *
+ * @param type The event type.
+ * @param a The first value (see `cmt_trace_type_t`).
+ * @param b The second value (see `cmt_trace_type_t`).
+ */
+static inline void cmt_trace(cmt_trace_type_t type, uint8_t a, uint16_t b) {
+#if CMT_TRACE
+    if (cmt_trace_on) {
+        cmt_trace_ring_t* ring = &cmt_trace_rings[(get_core_num() << 1) | (__get_current_exception() ? 1 : 0)];
+        uint32_t head = ring->head;
+        cmt_trace_event_t* event = &ring->events[head & (CMT_TRACE_DEPTH - 1)];
+        event->t = time_us_32();
+        event->type = (uint8_t)type;
+        event->a = a;
+        event->b = b;
+        ring->head = head + 1;
+    }
+#else
+    (void)type;
+    (void)a;
+    (void)b;
+#endif
+}
+
+/**
+ * @brief Clear the trace (of both cores).
+ * @ingroup mk_cmt_trace
+ *
+ * Only use while tracing is off.
+ */
+extern void cmt_trace_clear(void);
+
+/**
+ * @brief Print the trace (of both cores) to stdio.
+ * @ingroup mk_cmt_trace
+ *
+ * Tracing is turned off while the trace is printed (and then set back). It doesn't wait for the
+ * other core, so the last event of one of its rings may be only partly written.
+ *
+ * The format is a header line `#CMT-TRACE 2 <rings> <depth>`, and for each ring a line
+ * `@<ring> <events>` followed by a line for each event (oldest first) of 16 hex digits
+ * `tttttttt` `yy` `aa` `bbbb` (time, type, a, b). It ends with a `#END` line. Other lines
+ * (from other output) before the header are ignored by the decoder.
+ */
+extern void cmt_trace_dump(void);
+
+/**
+ * @brief Turn tracing on or off.
+ * @ingroup mk_cmt_trace
+ *
+ * Tracing is on at startup (if it is built in).
+ *
+ * @param on True to record events.
+ * @return The previous setting.
+ */
+extern bool cmt_trace_enable(bool on);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _MK_CMT_TRACE_H_
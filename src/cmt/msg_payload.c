@@ -0,0 +1,147 @@
+/**
+ * Message Payloads.
+ *
+ * Variable length message data that is passed between the cores without using malloc/free.
+ *
+ * See the msg_payload.h header for important information.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "msg_payload.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+
+#include <string.h>
+
+#ifndef CMT_PAYLOAD_ARENA_SIZE
+#define CMT_PAYLOAD_ARENA_SIZE 2048     // Bytes in each core's payload arena (power of 2, <= 32K)
+#endif
+
+static_assert((CMT_PAYLOAD_ARENA_SIZE & (CMT_PAYLOAD_ARENA_SIZE - 1)) == 0, "CMT_PAYLOAD_ARENA_SIZE must be a power of 2");
+static_assert(CMT_PAYLOAD_ARENA_SIZE <= 0x8000, "CMT_PAYLOAD_ARENA_SIZE must be <= 32K");
+
+/**
+ * @brief Header at the start of each block in an arena.
+ *
+ * `refs` holds a separate count for each core, and each core only changes its own,
+ * so the counts can be released without a lock.
+ */
+typedef struct _payload_hdr_ {
+    uint16_t size;                      // Size of the block (including this header)
+    volatile uint8_t refs[2];           // References held by each core
+} _payload_hdr_t;
+
+typedef struct _payload_arena_ {
+    uint32_t head;                      // Bytes allocated (only changed by the owning core)
+    uint32_t tail;                      // Bytes reclaimed (only changed by the owning core)
+    uint32_t data[CMT_PAYLOAD_ARENA_SIZE / sizeof(uint32_t)];
+} _payload_arena_t;
+
+static _payload_arena_t _arenas[2]; // One arena for each (allocating) core
+
+static inline _payload_hdr_t* _block_at(_payload_arena_t* arena, uint32_t pos) {
+    return ((_payload_hdr_t*)((uint8_t*)arena->data + (pos & (CMT_PAYLOAD_ARENA_SIZE - 1))));
+}
+
+/**
+ * @brief Reclaim the blocks at the tail of an arena that no longer have references.
+ */
+static void _arena_reclaim(_payload_arena_t* arena) {
+    while (arena->tail != arena->head) {
+        _payload_hdr_t* hdr = _block_at(arena, arena->tail);
+        if (hdr->refs[0] || hdr->refs[1]) {
+            break;
+        }
+        arena->tail += hdr->size;
+    }
+}
+
+/**
+ * @brief Get the header for a payload handle.
+ *
+ * The handle is `((arena + 1) << 16) | offset-of-header`, so 0 is never a valid handle.
+ */
+static inline _payload_hdr_t* _hdr_from_handle(uint32_t handle) {
+    uint32_t arena = (handle >> 16) - 1;
+    return ((_payload_hdr_t*)((uint8_t*)_arenas[arena].data + (handle & 0xFFFF)));
+}
+
+void* cmt_msg_payload_alloc(cmt_msg_t* msg, uint16_t size, uint8_t cores) {
+    uint8_t corenum = (uint8_t)get_core_num();
+    _payload_arena_t* arena = &_arenas[corenum];
+    uint32_t need = (sizeof(_payload_hdr_t) + size + 3) & ~3u;
+
+    _arena_reclaim(arena);
+    uint32_t offset = arena->head & (CMT_PAYLOAD_ARENA_SIZE - 1);
+    uint32_t to_end = CMT_PAYLOAD_ARENA_SIZE - offset;
+    uint32_t skip = (need > to_end ? to_end : 0); // Blocks don't wrap, so skip the end if needed
+    if (need + skip > CMT_PAYLOAD_ARENA_SIZE - (arena->head - arena->tail)) {
+        return (NULL);
+    }
+    if (skip) {
+        _payload_hdr_t* filler = _block_at(arena, arena->head);
+        filler->size = (uint16_t)skip;
+        filler->refs[0] = 0;
+        filler->refs[1] = 0;
+        arena->head += skip;
+        offset = 0;
+    }
+    _payload_hdr_t* hdr = _block_at(arena, arena->head);
+    hdr->size = (uint16_t)need;
+    hdr->refs[0] = ((cores & CMT_PAYLOAD_CORE0) ? 1 : 0);
+    hdr->refs[1] = ((cores & CMT_PAYLOAD_CORE1) ? 1 : 0);
+    arena->head += need;
+
+    msg->flags |= CMT_MSG_F_PAYLOAD;
+    msg->data.payload = ((uint32_t)(corenum + 1) << 16) | offset;
+
+    return (hdr + 1);
+}
+
+char* cmt_msg_payload_str(cmt_msg_t* msg, const char* str, uint8_t cores) {
+    size_t len = strlen(str) + 1;
+    char* copy = (len <= UINT16_MAX ? cmt_msg_payload_alloc(msg, (uint16_t)len, cores) : NULL);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return (copy);
+}
+
+void* cmt_msg_payload(const cmt_msg_t* msg) {
+    if (!(msg->flags & CMT_MSG_F_PAYLOAD)) {
+        return (NULL);
+    }
+    return (_hdr_from_handle(msg->data.payload) + 1);
+}
+
+void cmt_msg_payload_release(const cmt_msg_t* msg, uint8_t corenum) {
+    if (msg->flags & CMT_MSG_F_PAYLOAD) {
+        _payload_hdr_t* hdr = _hdr_from_handle(msg->data.payload);
+        __dmb(); // Done with the data before the space can be reused
+        if (hdr->refs[corenum]) {
+            hdr->refs[corenum]--;
+        }
+    }
+}
+
+uint32_t cmt_msg_payload_in_use(uint8_t corenum) {
+    if (corenum > 1) {
+        return (0);
+    }
+    const _payload_arena_t* arena = &_arenas[corenum];
+    uint32_t used = 0;
+    for (uint32_t pos = arena->tail; pos != arena->head;) {
+        const _payload_hdr_t* hdr = _block_at((_payload_arena_t*)arena, pos);
+        if (hdr->refs[0] || hdr->refs[1]) {
+            used += hdr->size;
+        }
+        pos += hdr->size;
+    }
+    return (used);
+}
+
+void msg_payload_module_init(void) {
+    memset(_arenas, 0, sizeof(_arenas));
+}
@@ -0,0 +1,125 @@
+/**
+ * Message Payloads.
+ *
+ * Variable length message data that is passed between the cores without using malloc/free.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _MK_MSG_PAYLOAD_H_
+#define _MK_MSG_PAYLOAD_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cmt.h"
+
+/**
+ * @file msg_payload.h
+ * @defgroup mk_msg_payload mk_msg_payload
+ * Variable length message payloads.
+ *
+ * Each core has a payload arena (a byte ring) that it allocates the payloads for the messages
+ * it posts from. A payload is allocated for the core(s) the message will be posted to, and
+ * carries a reference for each of them. The message carries a compact handle to the payload
+ * (rather than a pointer to malloc'ed memory), and the message loop releases the reference
+ * once the last handler for the message has run. When all references are released the space
+ * is reclaimed by the allocating core the next time it allocates.
+ *
+ * Each core only ever changes its own reference to a payload, and only the allocating core
+ * changes the arena indexes, so no lock is needed. The exception is a message that the
+ * destination core never gets (a post that fails, or a message evicted or replaced in its
+ * queue by the drop oldest or coalesce overflow policies): the posting core releases the
+ * destination core's reference. The destination core can't be changing that reference, as
+ * it hasn't taken the message. Payloads must not be allocated from an
+ * interrupt handler, and messages with payloads must not be scheduled (they are copied).
+ *
+ * This removes the heap (and its lock) from the message path, and lets the same
+ * message/payload be posted to both cores (`post_to_cores_...`).
+ *
+ * @addtogroup mk_msg_payload
+ * @include msg_payload.c
+ *
+*/
+
+/** @brief Core mask bit for Core 0 (same as the `post_to_cores_nowait` return bits) */
+#define CMT_PAYLOAD_CORE0 0x01
+/** @brief Core mask bit for Core 1 (same as the `post_to_cores_nowait` return bits) */
+#define CMT_PAYLOAD_CORE1 0x02
+/** @brief Core mask bits for both cores */
+#define CMT_PAYLOAD_CORES (CMT_PAYLOAD_CORE0 | CMT_PAYLOAD_CORE1)
+
+/**
+ * @brief Allocate a payload for a message.
+ * @ingroup mk_msg_payload
+ *
+ * The payload is allocated from the calling core's arena and attached to the message.
+ * The caller fills in the payload and then posts the message to the core(s) given.
+ *
+ * If a `..._nowait` post of the message fails, the reference for that core is released
+ * by the post.
+ *
+ * @param msg The message to attach the payload to.
+ * @param size The size of the payload in bytes.
+ * @param cores The core(s) the message will be posted to (CMT_PAYLOAD_CORE0 and/or CMT_PAYLOAD_CORE1).
+ * @return void* Pointer to the payload data, or NULL if there isn't space for it in the arena.
+ */
+extern void* cmt_msg_payload_alloc(cmt_msg_t* msg, uint16_t size, uint8_t cores);
+
+/**
+ * @brief Allocate a payload for a message and copy a string into it.
+ * @ingroup mk_msg_payload
+ *
+ * @see cmt_msg_payload_alloc()
+ *
+ * @param msg The message to attach the payload to.
+ * @param str The string to copy.
+ * @param cores The core(s) the message will be posted to (CMT_PAYLOAD_CORE0 and/or CMT_PAYLOAD_CORE1).
+ * @return char* Pointer to the copy of the string, or NULL if there isn't space for it in the arena.
+ */
+extern char* cmt_msg_payload_str(cmt_msg_t* msg, const char* str, uint8_t cores);
+
+/**
+ * @brief Get the payload data of a message.
+ * @ingroup mk_msg_payload
+ *
+ * @param msg The message.
+ * @return void* Pointer to the payload data, or NULL if the message doesn't have a payload.
+ */
+extern void* cmt_msg_payload(const cmt_msg_t* msg);
+
+/**
+ * @brief Release a core's reference to the payload of a message.
+ * @ingroup mk_msg_payload
+ *
+ * This is done by the message loop after the handlers for a message have run, and by
+ * a `..._nowait` post that fails. It doesn't normally need to be called otherwise.
+ *
+ * @param msg The message. Nothing is done if it doesn't have a payload.
+ * @param corenum The core number (0|1) releasing its reference.
+ */
+extern void cmt_msg_payload_release(const cmt_msg_t* msg, uint8_t corenum);
+
+/**
+ * @brief The bytes of a core's payload arena held by payloads that still have a reference.
+ * @ingroup mk_msg_payload
+ *
+ * For checking that payloads are released. The value is only exact when called from the
+ * core that owns the arena (the other core can be allocating from it).
+ *
+ * @param corenum The core number (0|1) of the arena (the core that allocated the payloads).
+ * @return The bytes in use (including the block headers).
+ */
+extern uint32_t cmt_msg_payload_in_use(uint8_t corenum);
+
+/**
+ * @brief Initialize the message payload arenas.
+ * @ingroup mk_msg_payload
+ */
+extern void msg_payload_module_init(void);
+
+#ifdef __cplusplus
+    }
+#endif
+#endif // _MK_MSG_PAYLOAD_H_
@@ -11,117 +11,854 @@
 #include "system_defs.h"
 #include "board.h"
 #include "cmt.h"
+#include "cmt_trace.h"
 #include "core1_main.h"
-#include "debug.h"
+#include "msg_payload.h"
+
+#include "hardware/sync.h"
 
 #include <stdio.h>
+#include <string.h>
+
+#ifndef CMT_QUEUE_DEPTH
+#define CMT_QUEUE_DEPTH 32              // Entries in each core-to-core message ring (power of 2)
+#endif
+#ifndef CMT_IRQ_QUEUE_DEPTH
+#define CMT_IRQ_QUEUE_DEPTH 16          // Entries in each interrupt-to-core message ring (power of 2)
+#endif
+#ifndef CMT_STAGE_DEPTH
+#define CMT_STAGE_DEPTH 16              // Messages a core holds (from its rings) to choose the next from
+#endif
+#ifndef CMT_BULK_STARVE_LIMIT
+#define CMT_BULK_STARVE_LIMIT 8         // Messages allowed ahead of a waiting bulk message
+#endif
+#ifndef CMT_QUEUE_IRQ_BLOCK_MAX_US
+#define CMT_QUEUE_IRQ_BLOCK_MAX_US 500  // Longest an interrupt handler waits for room in the other core's queue
+#endif
+
+static_assert((CMT_QUEUE_DEPTH & (CMT_QUEUE_DEPTH - 1)) == 0, "CMT_QUEUE_DEPTH must be a power of 2");
+static_assert((CMT_IRQ_QUEUE_DEPTH & (CMT_IRQ_QUEUE_DEPTH - 1)) == 0, "CMT_IRQ_QUEUE_DEPTH must be a power of 2");
+static_assert((CMT_SCHED_QUEUE_DEPTH & (CMT_SCHED_QUEUE_DEPTH - 1)) == 0, "CMT_SCHED_QUEUE_DEPTH must be a power of 2");
+// Each scheduled message reserves its slot in a scheduled message ring, so a ring smaller than
+// the pool would make scheduling fail before the pool is used up.
+static_assert(CMT_SCHED_QUEUE_DEPTH >= CMT_SCHEDULED_MESSAGES_MAX, "CMT_SCHED_QUEUE_DEPTH must be at least CMT_SCHEDULED_MESSAGES_MAX");
+
+/**
+ * @brief Single-producer/single-consumer message ring.
+ *
+ * The head is only changed by the producer and the tail is only changed by the consumer.
+ * The RP2040 has no data cache, and aligned 32 bit loads and stores are single-copy atomic,
+ * so a memory barrier between writing (reading) a message and publishing the new head (tail)
+ * is all that is needed. Posting and getting need no lock and don't disable interrupts.
+ */
+typedef struct _msg_ring_ {
+    volatile uint32_t head;             // Count of messages written (only changed by the producer)
+    volatile uint32_t tail;             // Count of messages read (only changed by the consumer, see below)
+    uint32_t mask;                      // Entries - 1
+    cmt_msg_t* msgs;
+    // Overflow counters (only changed by the producer)
+    uint32_t posted;
+    uint32_t dropped;
+    uint32_t evicted;
+    uint32_t coalesced;
+    uint32_t blocked;
+    uint32_t timeouts;
+    uint32_t high_water;
+} _msg_ring_t;
+
+/**
+ * @brief Overflow handling for a core's queue (its rings).
+ *
+ * With the drop oldest and coalesce policies a producer that finds its ring full changes the
+ * tail (or a waiting message), so for those the producer and consumer hold the queue's spin
+ * lock while they change the tail or messages. Other policies don't use the lock.
+ */
+typedef struct _msg_queue_ctl_ {
+    cmt_queue_overflow_t policy;
+    uint32_t block_timeout_us;          // Longest a blocking post waits (0 = no limit)
+    spin_lock_t* lock;
+} _msg_queue_ctl_t;
 
-#define CORE0_QUEUE_ENTRIES_MAX 32
-#define CORE1_QUEUE_ENTRIES_MAX 32
+/**
+ * @brief The producers of messages for a core. Each has its own ring, so every ring has a
+ *        single producer.
+ *
+ * Interrupt handlers get their own rings so they can't interrupt a core's post part way through.
+ * (Interrupt handlers that post messages must all run at the same priority (the SDK default),
+ * so that they can't interrupt one another.)
+ *
+ * The scheduled message alarm has a ring of its own. Its slots are reserved by the scheduling
+ * calls (see `core_sched_slots_free`), so a post to it never has to wait or drop a message.
+ */
+typedef enum _ring_source_ {
+    RING_SRC_CORE0 = 0,
+    RING_SRC_CORE1,
+    RING_SRC_IRQ_CORE0,
+    RING_SRC_IRQ_CORE1,
+    RING_SRC_SCHED,
+    RING_SRC_CNT,
+} _ring_source_t;
+
+/**
+ * @brief Messages taken from a core's rings, waiting to be chosen.
+ *
+ * Messages are held in arrival order. As long as they are all plain (normal priority
+ * without a deadline) they are handed out in that order. Otherwise the best one is
+ * chosen each time: urgent before normal before bulk, and within a class the earliest
+ * deadline first (then arrival order).
+ */
+typedef struct _msg_stage_ {
+    uint8_t count;
+    uint8_t special;                    // Messages that are not plain (urgent, bulk, or with a deadline)
+    uint8_t bulk;                       // Bulk messages
+    uint8_t bulk_skips;                 // Messages taken while a bulk message waited
+    uint32_t deadlines_missed;          // Messages taken after their deadline
+    cmt_msg_t msgs[CMT_STAGE_DEPTH];
+} _msg_stage_t;
 
 static bool _initialized = false;
 
-queue_t core0_queue;
-queue_t core1_queue;
+static cmt_msg_t _ring_msgs[2][2][CMT_QUEUE_DEPTH];             // [dest core][source core]
+static cmt_msg_t _ring_irq_msgs[2][2][CMT_IRQ_QUEUE_DEPTH];     // [dest core][source core]
+static cmt_msg_t _ring_sched_msgs[2][CMT_SCHED_QUEUE_DEPTH];     // [dest core]
+static _msg_ring_t _rings[2][RING_SRC_CNT];                     // [dest core][source]
+static uint8_t _ring_next[2];                                   // Ring to check first (round-robin)
+static _msg_stage_t _stage[2];                                  // [core]
+static _msg_queue_ctl_t _queue_ctl[2];                          // [dest core]
+
+/**
+ * @brief The pending message of a coalescible message ID for a core.
+ *
+ * The first post of the ID puts a stand-in (flagged CMT_MSG_F_COALESCED) in the queue and
+ * keeps the message here. Posts made while it is pending just replace the message here.
+ * When the stand-in is taken from the queue it is replaced by the message kept here, and
+ * the ID is no longer pending.
+ *
+ * A stand-in's data isn't used (the message here replaces it), so it holds the slot's post
+ * count from when it was made. If the stand-in is then dropped, that tells whether another
+ * post was merged into it in the meantime (and so still has to be delivered).
+ */
+typedef struct _msg_coalesce_slot_ {
+    bool pending;
+    uint32_t posts;                     // Posts into the slot (new and merged)
+    cmt_msg_t msg;
+} _msg_coalesce_slot_t;
+
+static uint32_t _coalesce_ids[(CMT_MSG_ID_CNT + 31) / 32];    // Coalescible IDs (bit per dense ID index)
+static _msg_coalesce_slot_t _coalesce[2][CMT_MSG_ID_CNT];      // [dest core][dense ID index]
+static spin_lock_t* _coalesce_lock;
+
+/**
+ * @brief The shared work queue (messages for core-agnostic handlers).
+ *
+ * Any core or interrupt handler posts to it, and either core's message loop takes from it,
+ * so it is changed under a spin lock. Messages are kept in post order. A message whose ID is
+ * being handled (by either core) is passed over until that handler is done, so the messages
+ * of an ID are handled one at a time, in order.
+ */
+typedef struct _msg_shared_queue_ {
+    spin_lock_t* lock;
+    volatile uint16_t count;
+    uint32_t busy[(CMT_MSG_ID_CNT + 31) / 32];  // IDs being handled (bit per dense ID index)
+    cmt_msg_t msgs[CMT_SHARED_QUEUE_DEPTH];
+    // Counters (changed under the lock)
+    uint32_t posted;
+    uint32_t dropped;
+    uint32_t blocked;
+    uint32_t timeouts;
+    uint32_t high_water;
+} _msg_shared_queue_t;
+
+static _msg_shared_queue_t _shared;
+
+static void _ring_init(_msg_ring_t* ring, cmt_msg_t* msgs, uint32_t entries) {
+    memset(ring, 0, sizeof(_msg_ring_t));
+    ring->mask = entries - 1;
+    ring->msgs = msgs;
+}
+
+static inline uint32_t _ring_level(const _msg_ring_t* ring) {
+    return (ring->head - ring->tail);
+}
+
+/**
+ * @brief Put up to `count` messages into a ring, publishing them with a single head update.
+ *
+ * @return The number of messages put (fewer than `count` if the ring filled up).
+ */
+static inline uint16_t _ring_put_n(_msg_ring_t* ring, const cmt_msg_t* msgs, uint16_t count) {
+    uint32_t head = ring->head;
+    uint32_t space = (ring->mask + 1) - (head - ring->tail);
+    if (count > space) {
+        count = (uint16_t)space;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        ring->msgs[(head + i) & ring->mask] = msgs[i];
+    }
+    __dmb(); // Messages must be written before they are published
+    ring->head = head + count;
+    if (count) {
+        __sev(); // Doorbell - wake the consumer if it is sleeping in its message loop
+    }
+    return (count);
+}
+
+/**
+ * @brief Take up to `max` messages from a ring, releasing their slots with a single tail update.
+ *
+ * @return The number of messages taken.
+ */
+static inline uint16_t _ring_take_n(_msg_ring_t* ring, cmt_msg_t* msgs, uint16_t max) {
+    uint32_t tail = ring->tail;
+    uint32_t level = ring->head - tail;
+    if (level == 0) {
+        return (0); // Empty
+    }
+    if (level > max) {
+        level = max;
+    }
+    __dmb(); // Don't read the messages before seeing the head
+    for (uint16_t i = 0; i < level; i++) {
+        msgs[i] = ring->msgs[(tail + i) & ring->mask];
+    }
+    __dmb(); // Messages must be read before the slots are released
+    ring->tail = tail + level;
+    return ((uint16_t)level);
+}
+
+/**
+ * @brief Get the ring that the calling core (or interrupt handler) posts to for a core.
+ */
+static inline _msg_ring_t* _ring_for_post(uint8_t dest_core) {
+    uint src = get_core_num();
+    if (__get_current_exception()) {
+        src += RING_SRC_IRQ_CORE0;
+    }
+    return (&_rings[dest_core][src]);
+}
+
+static inline bool _msg_is_plain(const cmt_msg_t* msg) {
+    return (CMT_MSG_PRIO_NORMAL == msg->prio && 0 == msg->deadline);
+}
+
+/**
+ * @brief Get the dense ID index of a message if it is coalescible (and doesn't have a payload).
+ *
+ * @return The index, or -1 if the message isn't coalesced.
+ */
+static inline int _coalesce_index(const cmt_msg_t* msg) {
+    int index = cmt_msg_id_index(msg->id);
+    if (index < 0 || (msg->flags & CMT_MSG_F_PAYLOAD) || !(_coalesce_ids[index >> 5] & (1u << (index & 31)))) {
+        return (-1);
+    }
+    return (index);
+}
+
+/**
+ * @brief Update the pending message for a coalescible ID, or make it pending.
+ *
+ * @param posts Set to the slot's post count (including this one).
+ * @return true if there was a pending message (it was updated, and nothing needs to be posted).
+ * @return false if the message is now pending (its stand-in needs to be posted).
+ */
+static bool _coalesce_post(uint8_t dest_core, int index, const cmt_msg_t* msg, uint32_t* posts) {
+    _msg_coalesce_slot_t* slot = &_coalesce[dest_core][index];
+    uint32_t flags = spin_lock_blocking(_coalesce_lock);
+    bool was_pending = slot->pending;
+    slot->pending = true;
+    slot->msg = *msg;
+    *posts = ++slot->posts;
+    spin_unlock(_coalesce_lock, flags);
+    return (was_pending);
+}
+
+/**
+ * @brief A stand-in was dropped (not posted, or evicted), so the ID is no longer pending.
+ *
+ * @param merged If not NULL (the stand-in wasn't posted), and a post was merged into the
+ *               pending message after the stand-in was made, set to that message. Its post
+ *               was counted as posted, so it must be posted again (as a new stand-in). If NULL
+ *               (the stand-in was evicted) the merged posts are evicted with it.
+ * @return true if the ID was made not pending, false if `merged` was set.
+ */
+static bool _coalesce_cancel(uint8_t dest_core, const cmt_msg_t* stand_in, cmt_msg_t* merged) {
+    _msg_coalesce_slot_t* slot = &_coalesce[dest_core][cmt_msg_id_index(stand_in->id)];
+    uint32_t flags = spin_lock_blocking(_coalesce_lock);
+    bool cancelled = (!merged || slot->posts == stand_in->data.ts_ms);
+    if (!cancelled) {
+        *merged = slot->msg;
+    }
+    slot->pending = false;
+    spin_unlock(_coalesce_lock, flags);
+    return (cancelled);
+}
+
+/**
+ * @brief Replace a stand-in taken from the queue with the pending message it stands for.
+ *
+ * The time posted is kept from the stand-in (the first post).
+ */
+static void _coalesce_take(uint8_t core, cmt_msg_t* msg) {
+    _msg_coalesce_slot_t* slot = &_coalesce[core][cmt_msg_id_index(msg->id)];
+    uint32_t t = msg->t;
+    uint32_t flags = spin_lock_blocking(_coalesce_lock);
+    *msg = slot->msg;
+    slot->pending = false;
+    spin_unlock(_coalesce_lock, flags);
+    msg->t = t;
+}
+
+/**
+ * @brief Move waiting messages from a core's rings into its stage (as room allows).
+ *
+ * The rings are checked round-robin (starting after the last one messages were taken
+ * from) so a busy producer can't starve the others.
+ */
+static void _stage_fill(uint8_t core, _msg_stage_t* stage) {
+    uint8_t start = _ring_next[core];
+    for (int i = 0; i < RING_SRC_CNT && stage->count < CMT_STAGE_DEPTH; i++) {
+        uint8_t src = (start + i) % RING_SRC_CNT;
+        _msg_ring_t* ring = &_rings[core][src];
+        if (0 == _ring_level(ring)) {
+            continue;
+        }
+        cmt_msg_t* dest = &stage->msgs[stage->count];
+        uint16_t taken;
+        if (_queue_ctl[core].lock) {
+            // A producer might drop or replace a waiting message
+            uint32_t flags = spin_lock_blocking(_queue_ctl[core].lock);
+            taken = _ring_take_n(ring, dest, CMT_STAGE_DEPTH - stage->count);
+            spin_unlock(_queue_ctl[core].lock, flags);
+        }
+        else {
+            taken = _ring_take_n(ring, dest, CMT_STAGE_DEPTH - stage->count);
+        }
+        if (taken) {
+            stage->count += taken;
+            _ring_next[core] = (src + 1) % RING_SRC_CNT;
+            for (int m = 0; m < taken; m++) {
+                if (!_msg_is_plain(&dest[m])) {
+                    stage->special++;
+                    if (CMT_MSG_PRIO_BULK == dest[m].prio) {
+                        stage->bulk++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Rank of a priority class (lower is taken first).
+ */
+static inline uint8_t _prio_rank(uint8_t prio) {
+    return (CMT_MSG_PRIO_URGENT == prio ? 0 : (CMT_MSG_PRIO_BULK == prio ? 2 : 1));
+}
+
+/**
+ * @brief Choose the index of the next message to take from a stage with special messages in it.
+ */
+static int _stage_select(_msg_stage_t* stage) {
+    bool starved = (stage->bulk && stage->bulk_skips >= CMT_BULK_STARVE_LIMIT);
+    int best = 0;
+    for (int i = 0; i < stage->count; i++) {
+        const cmt_msg_t* msg = &stage->msgs[i];
+        if (starved) {
+            // Take the oldest bulk message
+            if (CMT_MSG_PRIO_BULK == msg->prio) {
+                return (i);
+            }
+            continue;
+        }
+        if (i == 0) {
+            continue;
+        }
+        const cmt_msg_t* bmsg = &stage->msgs[best];
+        uint8_t rank = _prio_rank(msg->prio);
+        uint8_t brank = _prio_rank(bmsg->prio);
+        if (rank != brank) {
+            if (rank < brank) {
+                best = i;
+            }
+        }
+        else if (msg->deadline && (0 == bmsg->deadline || (int32_t)(msg->deadline - bmsg->deadline) < 0)) {
+            best = i;
+        }
+    }
+    return (best);
+}
+
+/**
+ * @brief Remove `n` messages starting at `index` from a stage (keeping the rest in order).
+ */
+static inline void _stage_remove(_msg_stage_t* stage, int index, int n) {
+    stage->count -= n;
+    memmove(&stage->msgs[index], &stage->msgs[index + n], (stage->count - index) * sizeof(cmt_msg_t));
+}
+
+/**
+ * @brief Take up to `max` messages for a core from its stage (after filling it from the rings).
+ *
+ * @return The number of messages taken.
+ */
+static uint16_t _stage_take(uint8_t core, cmt_msg_t* msgs, uint16_t max) {
+    _msg_stage_t* stage = &_stage[core];
+    _stage_fill(core, stage);
+    uint16_t count = 0;
+    if (0 == stage->special) {
+        // All plain - take them in arrival order
+        count = (stage->count < max ? stage->count : max);
+        memcpy(msgs, stage->msgs, count * sizeof(cmt_msg_t));
+        _stage_remove(stage, 0, count);
+        return (count);
+    }
+    uint32_t now = time_us_32();
+    while (count < max && stage->count > 0) {
+        int index = _stage_select(stage);
+        cmt_msg_t* msg = &stage->msgs[index];
+        if (CMT_MSG_PRIO_BULK == msg->prio) {
+            stage->bulk--;
+            stage->bulk_skips = 0;
+        }
+        else if (stage->bulk) {
+            stage->bulk_skips++;
+        }
+        if (!_msg_is_plain(msg)) {
+            stage->special--;
+        }
+        if (msg->deadline && (int32_t)(now - msg->deadline) > 0) {
+            stage->deadlines_missed++;
+        }
+        msgs[count++] = *msg;
+        _stage_remove(stage, index, 1);
+    }
+    return (count);
+}
+
+/**
+ * @brief Get up to `max` messages for a core.
+ *
+ * @return The number of messages retrieved.
+ */
+static uint16_t _get_msgs(uint8_t core, cmt_msg_t* msgs, uint16_t max) {
+    uint16_t count = _stage_take(core, msgs, max);
+    for (uint16_t i = 0; i < count; i++) {
+        if (msgs[i].flags & CMT_MSG_F_COALESCED) {
+            _coalesce_take(core, &msgs[i]);
+        }
+    }
+    return (count);
+}
+
+uint32_t core_msg_deadlines_missed(uint8_t corenum) {
+    return (corenum < 2 ? _stage[corenum].deadlines_missed : 0);
+}
+
+bool core_queue_overflow_set(uint8_t corenum, cmt_queue_overflow_t policy, uint32_t block_timeout_us) {
+    if (corenum > 1 || (corenum == 0 ? cmt_message_loop_0_running() : cmt_message_loop_1_running())) {
+        return (false);
+    }
+    _msg_queue_ctl_t* ctl = &_queue_ctl[corenum];
+    ctl->policy = policy;
+    ctl->block_timeout_us = block_timeout_us;
+    if (CMT_QUEUE_OVF_DROP_OLDEST == policy || CMT_QUEUE_OVF_COALESCE == policy) {
+        if (!ctl->lock) {
+            ctl->lock = spin_lock_init(spin_lock_claim_unused(true));
+        }
+    }
+    else if (ctl->lock) {
+        spin_lock_unclaim(spin_get_lock_num(ctl->lock));
+        ctl->lock = NULL;
+    }
+    return (true);
+}
+
+void core_queue_stats(uint8_t corenum, cmt_queue_stats_t* stats) {
+    memset(stats, 0, sizeof(cmt_queue_stats_t));
+    if (corenum > 1) {
+        return;
+    }
+    for (int src = 0; src < RING_SRC_CNT; src++) {
+        const _msg_ring_t* ring = &_rings[corenum][src];
+        stats->posted += ring->posted;
+        stats->dropped += ring->dropped;
+        stats->evicted += ring->evicted;
+        stats->coalesced += ring->coalesced;
+        stats->blocked += ring->blocked;
+        stats->timeouts += ring->timeouts;
+        if (ring->high_water > stats->high_water) {
+            stats->high_water = (uint16_t)ring->high_water;
+        }
+    }
+}
 
 void get_core0_msg_blocking(cmt_msg_t* msg) {
-    queue_remove_blocking(&core0_queue, msg);
+    while (!_get_msgs(0, msg, 1)) {
+        tight_loop_contents();
+    }
 }
 
 bool get_core0_msg_nowait(cmt_msg_t* msg) {
-    register bool retrieved = false;
-    uint32_t flags = save_and_disable_interrupts();
-    retrieved = queue_try_remove(&core0_queue, msg);
-    restore_interrupts(flags);
+    return (_get_msgs(0, msg, 1) > 0);
+}
 
-    return (retrieved);
+uint16_t get_core0_msgs_nowait(cmt_msg_t* msgs, uint16_t max) {
+    return (_get_msgs(0, msgs, max));
 }
 
 void get_core1_msg_blocking(cmt_msg_t* msg) {
-    queue_remove_blocking(&core1_queue, msg);
+    while (!_get_msgs(1, msg, 1)) {
+        tight_loop_contents();
+    }
 }
 
 bool get_core1_msg_nowait(cmt_msg_t* msg) {
-    register bool retrieved = false;
-    uint32_t flags = save_and_disable_interrupts();
-    retrieved = queue_try_remove(&core1_queue, msg);
-    restore_interrupts(flags);
+    return (_get_msgs(1, msg, 1) > 0);
+}
 
-    return (retrieved);
+uint16_t get_core1_msgs_nowait(cmt_msg_t* msgs, uint16_t max) {
+    return (_get_msgs(1, msgs, max));
+}
+
+bool core_msg_coalesce_set(msg_id_t id, bool coalesce) {
+    int index = cmt_msg_id_index(id);
+    if (index < 0) {
+        return (false);
+    }
+    if (coalesce) {
+        _coalesce_ids[index >> 5] |= (1u << (index & 31));
+    }
+    else {
+        _coalesce_ids[index >> 5] &= ~(1u << (index & 31));
+    }
+    return (true);
 }
 
 void multicore_module_init() {
     assert(!_initialized);
     _initialized = true;
-    queue_init(&core0_queue, sizeof(cmt_msg_t), CORE0_QUEUE_ENTRIES_MAX);
-    queue_init(&core1_queue, sizeof(cmt_msg_t), CORE1_QUEUE_ENTRIES_MAX);
+    for (int dest = 0; dest < 2; dest++) {
+        for (int src = 0; src < 2; src++) {
+            _ring_init(&_rings[dest][RING_SRC_CORE0 + src], _ring_msgs[dest][src], CMT_QUEUE_DEPTH);
+            _ring_init(&_rings[dest][RING_SRC_IRQ_CORE0 + src], _ring_irq_msgs[dest][src], CMT_IRQ_QUEUE_DEPTH);
+        }
+        _ring_init(&_rings[dest][RING_SRC_SCHED], _ring_sched_msgs[dest], CMT_SCHED_QUEUE_DEPTH);
+        _ring_next[dest] = 0;
+        memset(&_stage[dest], 0, sizeof(_msg_stage_t));
+        _queue_ctl[dest].policy = CMT_QUEUE_OVF_BLOCK;
+        _queue_ctl[dest].block_timeout_us = 0;
+        _queue_ctl[dest].lock = NULL;
+    }
+    memset(_coalesce_ids, 0, sizeof(_coalesce_ids));
+    memset(_coalesce, 0, sizeof(_coalesce));
+    _coalesce_lock = spin_lock_init(spin_lock_claim_unused(true));
+    memset(&_shared, 0, sizeof(_shared));
+    _shared.lock = spin_lock_init(spin_lock_claim_unused(true));
+    msg_payload_module_init();
     cmt_module_init();
 }
 
-static void _check_q0_level(char c, int id) {
-    if (debug_enabled()) {
-        if (CORE0_QUEUE_ENTRIES_MAX - queue_get_level(&core0_queue) < 4) {
-            cmt_msg_t msg;
-            uint32_t now = now_ms();
-            for (int i = 0; queue_get_level(&core0_queue) > 0; i++) {
-                get_core0_msg_blocking(&msg);
-                printf("\n!!! Q0-%02d:%#04.4x TIQ:%d !!!", i, msg.id, now - msg.t);
+/**
+ * @brief Note the messages posted to a ring (and the ring's high-water mark).
+ */
+static inline void _ring_posted(_msg_ring_t* ring, uint16_t count) {
+    ring->posted += count;
+    uint32_t level = _ring_level(ring);
+    if (level > ring->high_water) {
+        ring->high_water = level;
+    }
+}
+
+/**
+ * @brief Put a message into a full ring by replacing a waiting message with the same ID
+ *        (if `coalesce`) or by dropping the oldest waiting message.
+ *
+ * The message replaced or dropped is released for the destination core by this (the
+ * producer's) core. The destination core hasn't taken it (it takes messages with the lock
+ * held), so it won't change that reference (see msg_payload.h).
+ */
+static void _ring_put_evict(uint8_t dest_core, _msg_ring_t* ring, const cmt_msg_t* msg, bool coalesce) {
+    spin_lock_t* lock = _queue_ctl[dest_core].lock;
+    uint32_t flags = spin_lock_blocking(lock);
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+    if (head - tail > ring->mask) {
+        // Still full (the consumer only takes with the lock held, so this holds until unlocked)
+        if (coalesce) {
+            // Replace the newest waiting message with the same ID. It keeps its place in the queue.
+            for (uint32_t n = head; n != tail; n--) {
+                cmt_msg_t* waiting = &ring->msgs[(n - 1) & ring->mask];
+                if (waiting->id == msg->id) {
+                    if (waiting->flags & CMT_MSG_F_COALESCED) {
+                        _coalesce_cancel(dest_core, waiting, NULL); // (its merged posts are replaced too)
+                    }
+                    cmt_msg_payload_release(waiting, dest_core);
+                    *waiting = *msg;
+                    ring->coalesced++;
+                    spin_unlock(lock, flags);
+                    ring->posted++;
+                    __sev();
+                    return;
+                }
             }
-            panic("Q0 almost full. P%c:%#04.4x", c, id);
         }
+        cmt_msg_t* oldest = &ring->msgs[tail & ring->mask];
+        if (oldest->flags & CMT_MSG_F_COALESCED) {
+            _coalesce_cancel(dest_core, oldest, NULL);
+        }
+        cmt_msg_payload_release(oldest, dest_core);
+        __dmb();
+        ring->tail = tail + 1;
+        ring->evicted++;
+    }
+    spin_unlock(lock, flags);
+    // There is room now (only this producer can fill it)
+    _ring_put_n(ring, msg, 1);
+    _ring_posted(ring, 1);
+}
+
+/**
+ * @brief Wait (up to a timeout) for room in a ring and put a message.
+ *
+ * @param timeout_us The longest to wait (0 = no limit).
+ * @return true if the message was put.
+ */
+static bool _ring_put_wait(_msg_ring_t* ring, const cmt_msg_t* msg, uint32_t timeout_us) {
+    uint32_t start = time_us_32();
+    while (!_ring_put_n(ring, msg, 1)) {
+        if (timeout_us && (time_us_32() - start) >= timeout_us) {
+            return (false);
+        }
+        tight_loop_contents();
     }
+    _ring_posted(ring, 1);
+    return (true);
 }
 
-static void _check_q1_level(char c, int id) {
-    if (debug_enabled()) {
-        if (CORE1_QUEUE_ENTRIES_MAX - queue_get_level(&core1_queue) < 4) {
-            cmt_msg_t msg;
-            uint32_t now = now_ms();
-            for (int i = 0; queue_get_level(&core1_queue) > 0; i++) {
-                get_core1_msg_blocking(&msg);
-                printf("\n!!! Q1-%02d:%#04.4x !!!", i, msg.id, now - msg.t);
+static bool _post_ring(uint8_t dest_core, _msg_ring_t* ring, cmt_msg_t* msg, bool block);
+
+/**
+ * @brief Handle a message that doesn't fit in a full ring, as the destination core's overflow
+ *        policy says.
+ *
+ * @param block The post is a blocking post.
+ * @return true if the message was posted.
+ */
+static bool _post_overflow(uint8_t dest_core, _msg_ring_t* ring, cmt_msg_t* msg, bool block) {
+    const _msg_queue_ctl_t* ctl = &_queue_ctl[dest_core];
+    // The scheduled message ring is only full when a repeating message is behind. It doesn't
+    // wait or evict (its other messages have reserved their slots).
+    cmt_queue_overflow_t policy = (ring == &_rings[dest_core][RING_SRC_SCHED] ? CMT_QUEUE_OVF_DROP_NEWEST : ctl->policy);
+    switch (policy) {
+        case CMT_QUEUE_OVF_BLOCK:
+            if (block) {
+                uint32_t timeout = ctl->block_timeout_us;
+                bool wait = true;
+                if (__get_current_exception()) {
+                    // An interrupt handler can't wait for its own core (it can't take messages
+                    // while the handler runs), and must not wait long for the other core.
+                    wait = (dest_core != get_core_num());
+                    if (0 == timeout || timeout > CMT_QUEUE_IRQ_BLOCK_MAX_US) {
+                        timeout = CMT_QUEUE_IRQ_BLOCK_MAX_US;
+                    }
+                }
+                if (wait) {
+                    ring->blocked++;
+                    if (_ring_put_wait(ring, msg, timeout)) {
+                        cmt_trace(CMT_TRACE_POST, dest_core, msg->id);
+                        return (true);
+                    }
+                    ring->timeouts++;
+                }
             }
-            panic("Q1 almost full. P%c:%#04.4x TIQ:%d", c, id);
+            break;
+        case CMT_QUEUE_OVF_DROP_OLDEST:
+        case CMT_QUEUE_OVF_COALESCE:
+            _ring_put_evict(dest_core, ring, msg, (CMT_QUEUE_OVF_COALESCE == policy));
+            cmt_trace(CMT_TRACE_POST, dest_core, msg->id);
+            return (true);
+        default:
+            break;
+    }
+    if (msg->flags & CMT_MSG_F_COALESCED) {
+        cmt_msg_t merged;
+        if (!_coalesce_cancel(dest_core, msg, &merged)) {
+            // A later post was merged into it (and replaces it). Post that one.
+            return (_post_ring(dest_core, ring, &merged, block));
         }
     }
+    ring->dropped++;
+    cmt_trace(CMT_TRACE_POST_DROP, dest_core, msg->id);
+    cmt_msg_payload_release(msg, dest_core); // The core won't see it, so release its reference
+    return (false);
 }
 
-void post_to_core0_blocking(cmt_msg_t *msg) {
-    msg->t = now_ms();
-    _check_q0_level('B', msg->id);
-    uint32_t flags = save_and_disable_interrupts();
-    queue_add_blocking(&core0_queue, msg);
-    restore_interrupts(flags);
+// A post is traced once the message is in a ring (or merged), so a dropped one only shows
+// as a drop.
+static bool _post_ring(uint8_t dest_core, _msg_ring_t* ring, cmt_msg_t* msg, bool block) {
+    msg->t = time_us_32();
+    int cindex = _coalesce_index(msg);
+    if (cindex >= 0) {
+        uint32_t posts;
+        if (_coalesce_post(dest_core, cindex, msg, &posts)) {
+            // Merged into the pending one (last value wins)
+            ring->posted++;
+            ring->coalesced++;
+            cmt_trace(CMT_TRACE_POST, dest_core, msg->id);
+            return (true);
+        }
+        // Post a stand-in for it
+        cmt_msg_t stand_in = *msg;
+        stand_in.flags |= CMT_MSG_F_COALESCED;
+        stand_in.data.ts_ms = posts;
+        if (_ring_put_n(ring, &stand_in, 1) > 0) {
+            _ring_posted(ring, 1);
+            cmt_trace(CMT_TRACE_POST, dest_core, msg->id);
+            return (true);
+        }
+        return (_post_overflow(dest_core, ring, &stand_in, block));
+    }
+    if (_ring_put_n(ring, msg, 1) > 0) {
+        _ring_posted(ring, 1);
+        cmt_trace(CMT_TRACE_POST, dest_core, msg->id);
+        return (true);
+    }
+    return (_post_overflow(dest_core, ring, msg, block));
 }
 
-bool post_to_core0_nowait(cmt_msg_t *msg) {
-    msg->t = now_ms();
-    _check_q0_level('N', msg->id);
-    register bool posted = false;
-    uint32_t flags = save_and_disable_interrupts();
-    posted = queue_try_add(&core0_queue, msg);
-    restore_interrupts(flags);
+static inline bool _post(uint8_t dest_core, cmt_msg_t* msg, bool block) {
+    return (_post_ring(dest_core, _ring_for_post(dest_core), msg, block));
+}
 
+static uint16_t _post_batch(uint8_t dest_core, cmt_msg_t* msgs, uint16_t count, bool block) {
+    if (count == 0) {
+        return (0);
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        if (_coalesce_index(&msgs[i]) >= 0) {
+            // Coalescible messages are posted one at a time
+            uint16_t posted = 0;
+            while (posted < count && _post(dest_core, &msgs[posted], block)) {
+                posted++;
+            }
+            for (uint16_t r = posted + 1; r < count; r++) {
+                cmt_msg_payload_release(&msgs[r], dest_core); // The core won't see these, so release its references
+            }
+            return (posted);
+        }
+    }
+    _msg_ring_t* ring = _ring_for_post(dest_core);
+    uint32_t t = time_us_32();
+    for (uint16_t i = 0; i < count; i++) {
+        msgs[i].t = t;
+    }
+    uint16_t posted = _ring_put_n(ring, msgs, count);
+    _ring_posted(ring, posted);
+    for (uint16_t i = 0; i < posted; i++) {
+        cmt_trace(CMT_TRACE_POST, dest_core, msgs[i].id);
+    }
+    // Any that didn't fit are handled one at a time by the overflow policy. Stop at the first
+    // one that can't be posted, so that those posted are the first ones (in order).
+    while (posted < count && _post_overflow(dest_core, ring, &msgs[posted], block)) {
+        posted++;
+    }
+    for (uint16_t i = posted + 1; i < count; i++) {
+        cmt_msg_payload_release(&msgs[i], dest_core); // The core won't see these, so release its references
+    }
     return (posted);
 }
 
+/**
+ * @brief Count a shared work queue event (both cores post, so the counters need the lock).
+ */
+static void _shared_count(uint32_t* counter) {
+    uint32_t flags = spin_lock_blocking(_shared.lock);
+    (*counter)++;
+    spin_unlock(_shared.lock, flags);
+}
+
+/**
+ * @brief Put a message in the shared work queue if there is room.
+ */
+static bool _shared_put(const cmt_msg_t* msg) {
+    uint32_t flags = spin_lock_blocking(_shared.lock);
+    uint16_t count = _shared.count;
+    bool put = (count < CMT_SHARED_QUEUE_DEPTH);
+    if (put) {
+        _shared.msgs[count] = *msg;
+        _shared.count = ++count;
+        _shared.posted++;
+        if (count > _shared.high_water) {
+            _shared.high_water = count;
+        }
+    }
+    spin_unlock(_shared.lock, flags);
+    if (put) {
+        cmt_trace(CMT_TRACE_POST, CMT_SHARED_CORE, msg->id);
+        __sev(); // Wake a core that is sleeping in its message loop
+    }
+    return (put);
+}
+
+static bool _post_shared(cmt_msg_t* msg, bool block) {
+    if (cmt_msg_id_index(msg->id) < 0 || (msg->flags & CMT_MSG_F_PAYLOAD)) {
+        panic("CMT - Shared message %#04.4x must have a valid ID and no payload.", msg->id);
+    }
+    msg->t = time_us_32();
+    if (_shared_put(msg)) {
+        return (true);
+    }
+    if (block) {
+        // An interrupt handler must not wait long (the cores might both be busy). A message
+        // loop handles shared work while it waits (it makes the room it is waiting for).
+        uint32_t timeout = (__get_current_exception() ? CMT_QUEUE_IRQ_BLOCK_MAX_US : 0);
+        uint32_t start = time_us_32();
+        _shared_count(&_shared.blocked);
+        while (!timeout || (time_us_32() - start) < timeout) {
+            if (!cmt_shared_help()) {
+                tight_loop_contents();
+            }
+            if (_shared_put(msg)) {
+                return (true);
+            }
+        }
+        _shared_count(&_shared.timeouts);
+    }
+    _shared_count(&_shared.dropped);
+    cmt_trace(CMT_TRACE_POST_DROP, CMT_SHARED_CORE, msg->id);
+    return (false);
+}
+
+void post_to_core0_blocking(cmt_msg_t *msg) {
+    _post(0, msg, true);
+}
+
+bool post_to_core0_nowait(cmt_msg_t *msg) {
+    return (_post(0, msg, false));
+}
+
 void post_to_core1_blocking(cmt_msg_t* msg) {
-    msg->t = now_ms();
-    _check_q1_level('B', msg->id);
-    uint32_t flags = save_and_disable_interrupts();
-    queue_add_blocking(&core1_queue, msg);
-    restore_interrupts(flags);
+    _post(1, msg, true);
 }
 
 bool post_to_core1_nowait(cmt_msg_t* msg) {
-    msg->t = now_ms();
-    _check_q1_level('N', msg->id);
-    register bool posted = false;
-    uint32_t flags = save_and_disable_interrupts();
-    posted = queue_try_add(&core1_queue, msg);
-    restore_interrupts(flags);
+    return (_post(1, msg, false));
+}
 
-    return (posted);
+void post_to_core0_batch_blocking(cmt_msg_t* msgs, uint16_t count) {
+    _post_batch(0, msgs, count, true);
+}
+
+uint16_t post_to_core0_batch_nowait(cmt_msg_t* msgs, uint16_t count) {
+    return (_post_batch(0, msgs, count, false));
+}
+
+void post_to_core1_batch_blocking(cmt_msg_t* msgs, uint16_t count) {
+    _post_batch(1, msgs, count, true);
+}
+
+uint16_t post_to_core1_batch_nowait(cmt_msg_t* msgs, uint16_t count) {
+    return (_post_batch(1, msgs, count, false));
 }
 
 void post_to_cores_blocking(cmt_msg_t* msg) {
@@ -140,6 +877,69 @@ uint16_t post_to_cores_nowait(cmt_msg_t* msg) {
     return (retval);
 }
 
+uint16_t core_sched_slots_free(uint8_t corenum) {
+    return ((uint16_t)(CMT_SCHED_QUEUE_DEPTH - _ring_level(&_rings[corenum][RING_SRC_SCHED])));
+}
+
+bool post_scheduled_to_core(uint8_t corenum, cmt_msg_t* msg) {
+    return (_post_ring(corenum, &_rings[corenum][RING_SRC_SCHED], msg, false));
+}
+
+void post_shared_blocking(cmt_msg_t* msg) {
+    _post_shared(msg, true);
+}
+
+bool post_shared_nowait(cmt_msg_t* msg) {
+    return (_post_shared(msg, false));
+}
+
+uint16_t shared_msgs_waiting(void) {
+    return (_shared.count);
+}
+
+bool get_shared_msg_nowait(cmt_msg_t* msg) {
+    if (0 == _shared.count) {
+        return (false);
+    }
+    bool got = false;
+    uint32_t flags = spin_lock_blocking(_shared.lock);
+    uint16_t count = _shared.count;
+    for (uint16_t i = 0; i < count; i++) {
+        int index = cmt_msg_id_index(_shared.msgs[i].id);
+        uint32_t bit = (1u << (index & 31));
+        if (!(_shared.busy[index >> 5] & bit)) {
+            *msg = _shared.msgs[i];
+            memmove(&_shared.msgs[i], &_shared.msgs[i + 1], (count - i - 1) * sizeof(cmt_msg_t));
+            _shared.count = count - 1;
+            _shared.busy[index >> 5] |= bit;
+            got = true;
+            break;
+        }
+    }
+    spin_unlock(_shared.lock, flags);
+    return (got);
+}
+
+void shared_msg_done(const cmt_msg_t* msg) {
+    int index = cmt_msg_id_index(msg->id);
+    uint32_t flags = spin_lock_blocking(_shared.lock);
+    _shared.busy[index >> 5] &= ~(1u << (index & 31));
+    bool waiting = (_shared.count > 0);
+    spin_unlock(_shared.lock, flags);
+    if (waiting) {
+        __sev(); // A message with the ID might be waiting, let an idle core take it
+    }
+}
+
+void shared_queue_stats(cmt_queue_stats_t* stats) {
+    memset(stats, 0, sizeof(cmt_queue_stats_t));
+    stats->posted = _shared.posted;
+    stats->dropped = _shared.dropped;
+    stats->blocked = _shared.blocked;
+    stats->timeouts = _shared.timeouts;
+    stats->high_water = (uint16_t)_shared.high_water;
+}
+
 void start_core1() {
     // Start up the Core 1 main.
     //
@@ -14,7 +14,6 @@ extern "C" {
 #endif
 
 #include "pico/multicore.h"
-#include "pico/util/queue.h"
 #include "cmt.h"
 
 /**
@@ -32,13 +31,36 @@ extern "C" {
  * cause the Pico SDK/runtime to use them.
  *
  * For general purpose application communication between the functionality running on
- * the two cores queues will be used.
+ * the two cores queues will be used. Each core's queue is a set of lock-free single-producer/
+ * single-consumer rings (one for each core, and one for each core's interrupt handlers), so
+ * posting and getting messages doesn't take a lock or disable interrupts. Posting also does a
+ * SEV (the doorbell) to wake a core that is sleeping in its message loop. The ring depths
+ * are set by `CMT_QUEUE_DEPTH` and `CMT_IRQ_QUEUE_DEPTH` (powers of 2).
+ *
+ * Messages are taken from the rings into a small per-core stage, and the next message is
+ * chosen from there by priority class (`cmt_msg_prio_t`) and deadline.
+ *
+ * What happens when a post finds a core's queue full is set for each core by its overflow
+ * policy (`cmt_queue_overflow_t`), and is counted (`core_queue_stats`). An interrupt handler
+ * never waits for room in its own core's queue (the core can't empty it while the handler
+ * runs), and waits at most `CMT_QUEUE_IRQ_BLOCK_MAX_US` for the other core's.
+ *
+ * There is also a shared work queue, for messages handled by core-agnostic handlers
+ * (`cmt_shared_handlers_set`). Either core's message loop takes from it when its own queue is
+ * empty (or when the shared queue is backing up), so CPU-heavy work can use both cores. The
+ * messages of an ID are handled one at a time, in the order they were posted.
  *
  * @addtogroup mk_multicore
  * @include multicore.c
  *
 */
 
+#ifndef CMT_SHARED_QUEUE_DEPTH
+#define CMT_SHARED_QUEUE_DEPTH 32       // Entries in the shared work queue
+#endif
+
+#define CMT_SHARED_CORE 2               // 'Core' of the shared work queue (in traces)
+
 /**
  * @brief Get a message for Core 0 (from the Core 0 queue). Block until a message can be read.
  *
@@ -55,6 +77,18 @@ void get_core0_msg_blocking(cmt_msg_t *msg);
  */
 bool get_core0_msg_nowait(cmt_msg_t* msg);
 
+/**
+ * @brief Get up to `max` messages for Core 0 (from the Core 0 queue), but don't wait for any.
+ *
+ * The messages are taken from the queue together, so this is cheaper than getting them
+ * one at a time.
+ *
+ * @param msgs Buffer for at least `max` messages.
+ * @param max The maximum number of messages to get.
+ * @return The number of messages retrieved (0 if none were available).
+ */
+uint16_t get_core0_msgs_nowait(cmt_msg_t* msgs, uint16_t max);
+
 /**
  * @brief Get a message for Core 1 (from the Core 1 queue). Block until a message can be read.
  *
@@ -71,6 +105,102 @@ void get_core1_msg_blocking(cmt_msg_t* msg);
  */
 bool get_core1_msg_nowait(cmt_msg_t* msg);
 
+/**
+ * @brief Get up to `max` messages for Core 1 (from the Core 1 queue), but don't wait for any.
+ *
+ * @see get_core0_msgs_nowait()
+ *
+ * @param msgs Buffer for at least `max` messages.
+ * @param max The maximum number of messages to get.
+ * @return The number of messages retrieved (0 if none were available).
+ */
+uint16_t get_core1_msgs_nowait(cmt_msg_t* msgs, uint16_t max);
+
+/**
+ * @brief The number of messages for a core that were taken after their deadline had passed.
+ * @ingroup mk_multicore
+ *
+ * @param corenum The core number (0|1).
+ * @return The number of deadlines missed since startup.
+ */
+uint32_t core_msg_deadlines_missed(uint8_t corenum);
+
+/**
+ * @brief What a post does when the destination core's queue is full.
+ * @ingroup mk_multicore
+ */
+typedef enum _cmt_queue_overflow_ {
+    CMT_QUEUE_OVF_BLOCK = 0,            ///< Blocking posts wait for room (up to the block timeout), others are dropped
+    CMT_QUEUE_OVF_DROP_NEWEST,          ///< The message being posted is dropped
+    CMT_QUEUE_OVF_DROP_OLDEST,          ///< The oldest waiting message (from the same producer) is dropped
+    CMT_QUEUE_OVF_COALESCE,             ///< A waiting message with the same ID is replaced, else the oldest is dropped
+} cmt_queue_overflow_t;
+
+/**
+ * @brief Queue statistics for a core (totals for all of the producers).
+ * @ingroup mk_multicore
+ *
+ * @param posted Messages put into the queue (including ones that replaced a waiting message).
+ * @param dropped Messages that were not posted (including ones that timed out).
+ * @param evicted Waiting messages dropped to make room for a newer one.
+ * @param coalesced Waiting messages replaced by a newer one with the same ID.
+ * @param blocked Posts that had to wait for room.
+ * @param timeouts Posts that waited for room and timed out (and were dropped).
+ * @param high_water The most messages that have been waiting from a single producer.
+ */
+typedef struct _cmt_queue_stats_ {
+    uint32_t posted;
+    uint32_t dropped;
+    uint32_t evicted;
+    uint32_t coalesced;
+    uint32_t blocked;
+    uint32_t timeouts;
+    uint16_t high_water;
+} cmt_queue_stats_t;
+
+/**
+ * @brief Set the overflow policy of a core's queue.
+ * @ingroup mk_multicore
+ *
+ * The default is `CMT_QUEUE_OVF_BLOCK` with no timeout. The drop oldest and coalesce policies
+ * have a producer change the queue, so the consumer takes a (hardware) spin lock while getting
+ * messages. Because of that, the policy can only be set before the core's message loop starts.
+ *
+ * @param corenum The core number (0|1) of the queue.
+ * @param policy The overflow policy.
+ * @param block_timeout_us For `CMT_QUEUE_OVF_BLOCK`, the longest a blocking post waits for room
+ *        (0 to wait as long as needed).
+ * @return true The policy was set.
+ * @return false The core number isn't valid, or the core's message loop is already running.
+ */
+bool core_queue_overflow_set(uint8_t corenum, cmt_queue_overflow_t policy, uint32_t block_timeout_us);
+
+/**
+ * @brief Get the queue statistics for a core.
+ * @ingroup mk_multicore
+ *
+ * @param corenum The core number (0|1).
+ * @param stats Pointer to a statistics structure to fill with the values.
+ */
+void core_queue_stats(uint8_t corenum, cmt_queue_stats_t* stats);
+
+/**
+ * @brief Set whether a message ID is coalescible.
+ * @ingroup mk_multicore
+ *
+ * For a coalescible ID, a core's queue holds at most one of the messages at a time. A post
+ * made while one is waiting (posted, but not yet taken by the core's message loop) updates
+ * the waiting message in place (last value wins) rather than adding another one. The message
+ * keeps the place in the queue of the first post. Use this for messages that only say that
+ * something happened or changed. Messages with a payload are not coalesced.
+ *
+ * @param id The message ID.
+ * @param coalesce True to make the ID coalescible, false to make it normal.
+ * @return true The setting was made.
+ * @return false The ID isn't valid.
+ */
+bool core_msg_coalesce_set(msg_id_t id, bool coalesce);
+
 /**
  * @brief Initialize the multicore environment to be ready to run the core1 functionality.
  * @ingroup mk_multicore
@@ -127,6 +257,54 @@ void post_to_core1_blocking(cmt_msg_t* msg);
  */
 bool post_to_core1_nowait(cmt_msg_t* msg);
 
+/**
+ * @brief Post an array of messages to Core 0. Block until they have all been posted.
+ * @ingroup mk_multicore
+ *
+ * The messages are published to the queue together (a single update of the queue's
+ * write index), as space allows. Use this for bursts of messages.
+ *
+ * @param msgs The messages to post.
+ * @param count The number of messages.
+ */
+void post_to_core0_batch_blocking(cmt_msg_t* msgs, uint16_t count);
+
+/**
+ * @brief Post an array of messages to Core 0. Post as many as there is room for without waiting.
+ * @ingroup mk_multicore
+ *
+ * The messages are published to the queue together (a single update of the queue's write index).
+ * If there isn't room for all of them, the first ones (in order) are posted.
+ *
+ * @param msgs The messages to post.
+ * @param count The number of messages.
+ * @return The number of messages posted.
+ */
+uint16_t post_to_core0_batch_nowait(cmt_msg_t* msgs, uint16_t count);
+
+/**
+ * @brief Post an array of messages to Core 1. Block until they have all been posted.
+ * @ingroup mk_multicore
+ *
+ * @see post_to_core0_batch_blocking()
+ *
+ * @param msgs The messages to post.
+ * @param count The number of messages.
+ */
+void post_to_core1_batch_blocking(cmt_msg_t* msgs, uint16_t count);
+
+/**
+ * @brief Post an array of messages to Core 1. Post as many as there is room for without waiting.
+ * @ingroup mk_multicore
+ *
+ * @see post_to_core0_batch_nowait()
+ *
+ * @param msgs The messages to post.
+ * @param count The number of messages.
+ * @return The number of messages posted.
+ */
+uint16_t post_to_core1_batch_nowait(cmt_msg_t* msgs, uint16_t count);
+
 /**
  * @brief Post a message to both Core 0 and Core 1 (using the Core 0 and Core 1 queues).
  * @ingroup mk_multicore
@@ -135,6 +313,7 @@ bool post_to_core1_nowait(cmt_msg_t* msg);
  *
  * @note Since this is posting the same message to both cores, it should not be used for messages
  *       that contain allocated resources, as both core's message handlers would try to free them.
+ *       Use a payload allocated for both cores (`cmt_msg_payload_alloc`) instead.
  *
  * @param msg The message to post.
  */
@@ -150,12 +329,105 @@ void post_to_cores_blocking(cmt_msg_t* msg);
  *
  * @note Since this is posting the same message to both cores, it should not be used for messages
  *       that contain allocated resources, as both core's message handlers would try to free them.
+ *       Use a payload allocated for both cores (`cmt_msg_payload_alloc`) instead.
  *
  * @param msg The message to post.
  * @return 0 Could not post to either. 1 Posted to Core 0. 2 Posted to Core 1. 3 Posted to both cores.
  */
 uint16_t post_to_cores_nowait(cmt_msg_t* msg);
 
+/**
+ * @brief The number of free slots in a core's scheduled message ring.
+ * @ingroup mk_multicore
+ *
+ * The scheduled message alarm posts to a ring of its own for each core. The scheduling calls
+ * reserve a slot for each one-shot message (when it is scheduled), so posting it from the
+ * alarm interrupt can't fail. Repeating messages only use the slots that aren't reserved.
+ *
+ * @param corenum The core number (0|1).
+ * @return The number of slots that don't hold a message.
+ */
+uint16_t core_sched_slots_free(uint8_t corenum);
+
+/**
+ * @brief Post a message to a core's scheduled message ring (for the scheduled message alarm).
+ * @ingroup mk_multicore
+ *
+ * This never waits, prints, or evicts a message, so it can be used from an interrupt handler.
+ * The ring has a single producer, so only the scheduled message alarm handler may use it.
+ *
+ * @param corenum The core number (0|1).
+ * @param msg The message to post.
+ * @return true if it was posted. false if the ring was full (it is counted as dropped).
+ */
+bool post_scheduled_to_core(uint8_t corenum, cmt_msg_t* msg);
+
+/**
+ * @brief Post a message to the shared work queue (for either core). Wait for room if needed.
+ * @ingroup mk_multicore
+ *
+ * The message is handled by the core-agnostic handlers for its ID (`cmt_shared_handlers_set`),
+ * on whichever core takes it. Messages posted for an ID are handled one at a time, in the order
+ * posted, but there is no order between them and the messages posted to a core.
+ *
+ * The message must not have a payload (the core that will release it isn't known). An interrupt
+ * handler waits at most `CMT_QUEUE_IRQ_BLOCK_MAX_US` for room. A message loop handles shared
+ * messages while it waits (`cmt_shared_help`), so its handlers can run before this returns.
+ *
+ * @param msg The message to post.
+ */
+void post_shared_blocking(cmt_msg_t* msg);
+
+/**
+ * @brief Post a message to the shared work queue (for either core). Do not wait if it is full.
+ * @ingroup mk_multicore
+ *
+ * @see post_shared_blocking
+ *
+ * @param msg The message to post.
+ * @return true The message was posted.
+ * @return false The queue was full (the message was dropped).
+ */
+bool post_shared_nowait(cmt_msg_t* msg);
+
+/**
+ * @brief The number of messages waiting in the shared work queue.
+ * @ingroup mk_multicore
+ *
+ * @return The number of messages.
+ */
+uint16_t shared_msgs_waiting(void);
+
+/**
+ * @brief Take the first message from the shared work queue whose ID isn't being handled.
+ * @ingroup mk_multicore
+ *
+ * Used by the message loops. The ID is marked as being handled until `shared_msg_done` is
+ * called with the message.
+ *
+ * @param msg Buffer for the message.
+ * @return true If a message was taken.
+ */
+bool get_shared_msg_nowait(cmt_msg_t* msg);
+
+/**
+ * @brief Mark a message taken from the shared work queue as handled.
+ * @ingroup mk_multicore
+ *
+ * @param msg The message (from `get_shared_msg_nowait`).
+ */
+void shared_msg_done(const cmt_msg_t* msg);
+
+/**
+ * @brief Get the counters of the shared work queue.
+ * @ingroup mk_multicore
+ *
+ * (`evicted` and `coalesced` are always 0.)
+ *
+ * @param stats Buffer for the counters.
+ */
+void shared_queue_stats(cmt_queue_stats_t* stats);
+
 /**
  * @brief Start the Core 1 functionality.
  * @ingroup multi_core
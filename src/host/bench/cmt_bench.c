@@ -0,0 +1,284 @@
+/**
+ * CMT Benchmarks (host build).
+ *
+ * Measures the CMT runtime running on the host:
+ *  1. Throughput of single (blocking) posts from core 0 to core 1.
+ *  2. Throughput of batch posts from core 0 to core 1.
+ *  3. Throughput of work (busy handlers, two message IDs) through the shared work queue,
+ *     and how it was split between the cores (checking the per-ID order).
+ *  4. Latency from a post (core 0) to the handler being called (core 1).
+ *  5. Jitter of a repeating scheduled message (from the alarm 'IRQ' to core 0).
+ *
+ * The sequence is a coroutine in the core 0 message loop. The existing message IDs are used
+ * (there is no message ID block for tests) - the ones used are not coalescible and don't have
+ * handlers in the host build.
+ *
+ * The results are for comparing changes to the runtime on the same machine. The cores are
+ * threads, so the absolute numbers depend on the host (and how many CPUs it has).
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "cmt.h"
+#include "cmt_co.h"
+#include "multicore.h"
+
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MSG_BENCH_FLOOD MSG_BE_TEST             // core 0 -> core 1 (throughput)
+#define MSG_BENCH_PING MSG_UI_INITIALIZED       // core 0 -> core 1 (latency)
+#define MSG_BENCH_PONG MSG_BE_INITIALIZED       // core 1 -> core 0 (latency reply)
+#define MSG_BENCH_DONE MSG_DISPLAY_MESSAGE      // core 1 -> core 0 (throughput run received)
+#define MSG_BENCH_TICK MSG_BACKEND_NOOP         // scheduled -> core 0 (jitter)
+#define MSG_BENCH_START MSG_UI_NOOP             // -> core 0 (start the benchmarks)
+#define MSG_BENCH_WORK_A MSG_COMMON_NOOP        // shared (work)
+#define MSG_BENCH_WORK_B MSG_CMT_SLEEP          // shared (work)
+
+#define BENCH_MSGS_DEFAULT 200000
+#define BENCH_BATCH 8
+#define BENCH_PINGS 20000
+#define BENCH_TICKS 2000
+#define BENCH_TICK_PERIOD_US 1000
+#define BENCH_WORK_MSGS 20000
+#define BENCH_WORK_NS 20000
+
+static uint32_t _msgs = BENCH_MSGS_DEFAULT;     // Messages for each throughput run
+static volatile uint32_t _flood_received;       // (core 1)
+static uint32_t _flood_expected;                // (core 1)
+static uint32_t _latency_ns[BENCH_PINGS];       // (written by core 1, read by core 0 once the pings are done)
+static uint32_t _lateness_us[BENCH_TICKS];
+static uint32_t _work_done;                     // (both cores, atomic)
+static uint32_t _work_by_core[2];
+static uint32_t _work_next_seq[2];              // Next sequence number expected for each work ID
+static uint32_t _work_out_of_order;
+
+static cmt_co_t _bench_co;
+
+
+// ============================================
+// Internal functions
+// ============================================
+
+static uint64_t _ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec);
+}
+
+static int _u32_cmp(const void* a, const void* b) {
+    uint32_t va = *(const uint32_t*)a;
+    uint32_t vb = *(const uint32_t*)b;
+    return (va < vb ? -1 : (va > vb ? 1 : 0));
+}
+
+static void _percentiles_print(const char* label, const char* units, uint32_t* values, uint32_t count) {
+    qsort(values, count, sizeof(uint32_t), _u32_cmp);
+    printf("%-24s p50 %6u  p90 %6u  p99 %6u  p99.9 %6u  max %6u %s\n", label,
+        values[count / 2], values[(count * 90) / 100], values[(count * 99) / 100],
+        values[(count * 999) / 1000], values[count - 1], units);
+}
+
+static void _throughput_print(const char* label, uint64_t start_ns) {
+    double secs = (double)(_ns() - start_ns) / 1e9;
+    printf("%-24s %9u msgs in %7.3f s  %10.0f msgs/s\n", label, _msgs, secs, (double)_msgs / secs);
+}
+
+static void _queue_stats_print(uint8_t corenum) {
+    cmt_queue_stats_t stats;
+    core_queue_stats(corenum, &stats);
+    printf("Core %d queue:            posted %u  blocked %u  dropped %u  high-water %u\n",
+        corenum, stats.posted, stats.blocked, stats.dropped, stats.high_water);
+}
+
+
+// ============================================
+// Benchmark sequence (core 0 coroutine)
+// ============================================
+
+static cmt_co_result_t _bench_run(cmt_co_t* co) {
+    static uint64_t start_ns;
+    static uint64_t sched_base;
+    static cmt_sm_handle_t tick_handle;
+    static uint32_t i;
+    cmt_msg_t msg;
+
+    CMT_CO_BEGIN(co);
+    // 1. Single posts
+    memset(&msg, 0, sizeof(msg));
+    msg.id = MSG_BENCH_FLOOD;
+    start_ns = _ns();
+    for (i = 0; i < _msgs; i++) {
+        post_to_core1_blocking(&msg);
+    }
+    CMT_CO_AWAIT_MSG(co, MSG_BENCH_DONE);
+    _throughput_print("Post (single):", start_ns);
+
+    // 2. Batch posts
+    {
+        cmt_msg_t msgs[BENCH_BATCH];
+        memset(msgs, 0, sizeof(msgs));
+        for (int b = 0; b < BENCH_BATCH; b++) {
+            msgs[b].id = MSG_BENCH_FLOOD;
+        }
+        start_ns = _ns();
+        for (i = 0; i < _msgs; i += BENCH_BATCH) {
+            post_to_core1_batch_blocking(msgs, BENCH_BATCH);
+        }
+    }
+    CMT_CO_AWAIT_MSG(co, MSG_BENCH_DONE);
+    _throughput_print("Post (batch of 8):", start_ns);
+
+    // 3. Shared work
+    start_ns = _ns();
+    for (i = 0; i < BENCH_WORK_MSGS; i++) {
+        memset(&msg, 0, sizeof(msg));
+        msg.id = ((i & 1) ? MSG_BENCH_WORK_B : MSG_BENCH_WORK_A);
+        msg.data.status = (int32_t)(i >> 1); // Sequence number (for the ID)
+        post_shared_blocking(&msg);
+    }
+    CMT_CO_AWAIT_MSG(co, MSG_BENCH_DONE);
+    {
+        double secs = (double)(_ns() - start_ns) / 1e9;
+        printf("%-24s %9u msgs in %7.3f s  %10.0f msgs/s (core 0 %u, core 1 %u, out of order %u)\n", "Shared work (20us):",
+            BENCH_WORK_MSGS, secs, (double)BENCH_WORK_MSGS / secs, _work_by_core[0], _work_by_core[1], _work_out_of_order);
+    }
+
+    // 4. Post to dispatch latency (one message at a time)
+    for (i = 0; i < BENCH_PINGS; i++) {
+        memset(&msg, 0, sizeof(msg));
+        msg.id = MSG_BENCH_PING;
+        msg.data.ts_us = _ns();
+        post_to_core1_blocking(&msg);
+        CMT_CO_AWAIT_MSG(co, MSG_BENCH_PONG);
+    }
+    _percentiles_print("Post to handler:", "ns", _latency_ns, BENCH_PINGS);
+
+    // 5. Scheduled message jitter
+    memset(&msg, 0, sizeof(msg));
+    msg.id = MSG_BENCH_TICK;
+    sched_base = time_us_64();
+    tick_handle = schedule_msg_every_us(BENCH_TICK_PERIOD_US, &msg);
+    for (i = 0; i < BENCH_TICKS; i++) {
+        CMT_CO_AWAIT_MSG(co, MSG_BENCH_TICK);
+        // (a period that is missed is skipped, so this is the time past the latest period)
+        _lateness_us[i] = (uint32_t)((time_us_64() - sched_base) % BENCH_TICK_PERIOD_US);
+    }
+    printf("Scheduled (%d us):      %u missed\n", BENCH_TICK_PERIOD_US, scheduled_msg_handle_missed(tick_handle));
+    scheduled_msg_handle_cancel(tick_handle);
+    _percentiles_print("Scheduled lateness:", "us", _lateness_us, BENCH_TICKS);
+
+    _queue_stats_print(1);
+    exit(EXIT_SUCCESS);
+    CMT_CO_END(co);
+}
+
+
+// ============================================
+// Message handler functions
+// ============================================
+
+static void _handle_start(cmt_msg_t* msg) {
+    cmt_co_start(&_bench_co, _bench_run, NULL);
+}
+
+static void _handle_flood(cmt_msg_t* msg) {
+    if (++_flood_received == _flood_expected) {
+        _flood_received = 0;
+        cmt_msg_t done = { MSG_BENCH_DONE };
+        post_to_core0_blocking(&done);
+    }
+}
+
+static void _handle_work(cmt_msg_t* msg) {
+    // Core-agnostic (either core). The messages of an ID are handled one at a time, in order.
+    int w = (MSG_BENCH_WORK_B == msg->id ? 1 : 0);
+    if ((uint32_t)msg->data.status != _work_next_seq[w]) {
+        _work_out_of_order++;
+    }
+    _work_next_seq[w] = (uint32_t)msg->data.status + 1;
+    uint64_t end = _ns() + BENCH_WORK_NS;
+    while (_ns() < end) {
+    }
+    __atomic_fetch_add(&_work_by_core[get_core_num()], 1, __ATOMIC_RELAXED);
+    if (__atomic_add_fetch(&_work_done, 1, __ATOMIC_ACQ_REL) == BENCH_WORK_MSGS) {
+        cmt_msg_t done = { MSG_BENCH_DONE };
+        post_to_core0_blocking(&done);
+    }
+}
+
+static void _handle_ping(cmt_msg_t* msg) {
+    static uint32_t pings;
+    if (pings < BENCH_PINGS) {
+        _latency_ns[pings++] = (uint32_t)(_ns() - msg->data.ts_us);
+    }
+    cmt_msg_t pong = { MSG_BENCH_PONG };
+    post_to_core0_blocking(&pong);
+}
+
+static const msg_handler_entry_t _start_handler_entry = { MSG_BENCH_START, _handle_start };
+static const msg_handler_entry_t _flood_handler_entry = { MSG_BENCH_FLOOD, _handle_flood };
+static const msg_handler_entry_t _ping_handler_entry = { MSG_BENCH_PING, _handle_ping };
+static const msg_handler_entry_t _work_a_handler_entry = { MSG_BENCH_WORK_A, _handle_work };
+static const msg_handler_entry_t _work_b_handler_entry = { MSG_BENCH_WORK_B, _handle_work };
+
+static const msg_handler_entry_t* _core0_handler_entries[] = {
+    &_start_handler_entry,
+    ((msg_handler_entry_t*)0), // Last entry must be a NULL
+};
+
+static const msg_handler_entry_t* _core1_handler_entries[] = {
+    &_flood_handler_entry,
+    &_ping_handler_entry,
+    ((msg_handler_entry_t*)0), // Last entry must be a NULL
+};
+
+static const msg_handler_entry_t* _shared_handler_entries[] = {
+    &_work_a_handler_entry,
+    &_work_b_handler_entry,
+    ((msg_handler_entry_t*)0), // Last entry must be a NULL
+};
+
+static const idle_task_entry_t* _no_idle_tasks[] = {
+    ((idle_task_entry_t*)0), // Last entry must be a NULL
+};
+
+static const msg_loop_cntx_t _core0_loop_cntx = { 0, _core0_handler_entries, _no_idle_tasks };
+static const msg_loop_cntx_t _core1_loop_cntx = { 1, _core1_handler_entries, _no_idle_tasks };
+
+static void _core1_main(void) {
+    message_loop(&_core1_loop_cntx);
+}
+
+
+// ============================================
+// Main
+// ============================================
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        _msgs = (uint32_t)strtoul(argv[1], NULL, 0);
+    }
+    _msgs = ((_msgs + BENCH_BATCH - 1) / BENCH_BATCH) * BENCH_BATCH; // (whole batches)
+    if (_msgs == 0) {
+        _msgs = BENCH_BATCH;
+    }
+    _flood_expected = _msgs;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("CMT host benchmarks (%u messages per throughput run)\n", _msgs);
+
+    multicore_module_init();
+    cmt_shared_handlers_set(_shared_handler_entries);
+    multicore_launch_core1(_core1_main);
+    cmt_msg_t msg = { MSG_BENCH_START };
+    post_to_core0_blocking(&msg);
+    message_loop(&_core0_loop_cntx);
+
+    return (0);
+}
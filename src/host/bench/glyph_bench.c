@@ -0,0 +1,122 @@
+/**
+ * Glyph Rendering Benchmark (host build).
+ *
+ * Compares the text renderer's glyph row kernels (see glyph_render.h):
+ *  1. Checks that the pixel pair table kernel, and the interpolator kernel (on the SDK shim's
+ *     interpolator model), render the same pixels as the plain per-pixel kernel, for every
+ *     character (normal and inverse) in every color-byte.
+ *  2. Measures the characters per second of each, rendering full screen lines (32 columns,
+ *     all 16 glyph rows) of mixed text and colors.
+ *
+ * The numbers are for comparing the kernels on the same machine. The host has a data cache
+ * and a wider bus than the Cortex-M0+, so the ratio on the RP2040 isn't the same. The
+ * interpolator kernel's number is for the model (the interpolators are single cycle I/O on
+ * the RP2040), so it only shows that it runs.
+ *
+ *   glyph_bench [lines (20000)]
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "glyph_render.h"
+#include "font_10_16.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_COLS 32
+#define BENCH_LINES_DEFAULT 20000
+
+// (the same values as the display's Color16 map)
+static const rgb16_t _palette[16] = {
+    0x0000, 0x0011, 0x4C80, 0x079E, 0xE000, 0xFA1F, 0x6080, 0xB5D2,
+    0x6B49, 0x033F, 0x07E0, 0x77FF, 0xFA40, 0xFC5B, 0xFFEA, 0xFFFF,
+};
+
+typedef void (*glyph_kernel_fn)(rgb16_t* dst, const font_info_t* fi, const uint8_t* text, const colorbyte_t* colors,
+    uint16_t ncols, int glyph_line, const glyph_lut_t lut);
+
+static glyph_lut_t _lut;
+static uint32_t _buf_ref[BENCH_COLS * 10 / 2];  // (32-bit aligned)
+static uint32_t _buf_lut[BENCH_COLS * 10 / 2];
+
+static uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec);
+}
+
+/**
+ * @brief Check a table kernel against the plain one.
+ *
+ * @return The number of glyph rows that were different.
+ */
+static unsigned _check(const font_info_t* fi, glyph_kernel_fn kernel) {
+    uint8_t text[BENCH_COLS];
+    colorbyte_t colors[BENCH_COLS];
+    unsigned bad = 0;
+    for (int cb = 0; cb < 256; cb++) {
+        for (int c0 = 0; c0 < 256; c0 += BENCH_COLS) {
+            for (int n = 0; n < BENCH_COLS; n++) {
+                text[n] = (uint8_t)(c0 + n);
+                colors[n] = (colorbyte_t)cb;
+            }
+            for (int row = 0; row < fi->height; row++) {
+                glyph_row_render_ref((rgb16_t*)_buf_ref, fi, text, colors, BENCH_COLS, row, _palette);
+                kernel((rgb16_t*)_buf_lut, fi, text, colors, BENCH_COLS, row, _lut);
+                if (memcmp(_buf_ref, _buf_lut, BENCH_COLS * fi->width * sizeof(rgb16_t))) {
+                    bad++;
+                }
+            }
+        }
+    }
+    return (bad);
+}
+
+int main(int argc, char** argv) {
+    const font_info_t* fi = &font_10_16;
+    unsigned lines = (argc > 1 ? (unsigned)strtoul(argv[1], NULL, 0) : BENCH_LINES_DEFAULT);
+    uint8_t text[BENCH_COLS];
+    colorbyte_t colors[BENCH_COLS];
+    volatile uint32_t sink = 0;
+
+    glyph_lut_build(_lut, _palette);
+    unsigned bad = _check(fi, glyph_row_render);
+    printf("Glyph render check (table):        %s (%u rows different)\n", (bad ? "FAIL" : "ok"), bad);
+    unsigned bad_interp = _check(fi, glyph_row_render_interp);
+    printf("Glyph render check (interpolator): %s (%u rows different)\n", (bad_interp ? "FAIL" : "ok"), bad_interp);
+    bad += bad_interp;
+
+    srand(1);
+    for (int n = 0; n < BENCH_COLS; n++) {
+        text[n] = (uint8_t)(0x20 + (rand() % 0x60)) | ((rand() % 8) ? 0 : DISP_CHAR_INVERT_BIT);
+        colors[n] = (colorbyte_t)(rand() & 0xff);
+    }
+    static const char* names[3] = { "Per pixel (before):", "Pixel pair table:", "Interpolator (model):" };
+    double cps[3];
+    for (int k = 0; k < 3; k++) {
+        uint64_t start = _now_ns();
+        for (unsigned l = 0; l < lines; l++) {
+            for (int row = 0; row < fi->height; row++) {
+                if (0 == k) {
+                    glyph_row_render_ref((rgb16_t*)_buf_ref, fi, text, colors, BENCH_COLS, row, _palette);
+                }
+                else if (1 == k) {
+                    glyph_row_render((rgb16_t*)_buf_lut, fi, text, colors, BENCH_COLS, row, _lut);
+                }
+                else {
+                    glyph_row_render_interp((rgb16_t*)_buf_lut, fi, text, colors, BENCH_COLS, row, _lut);
+                }
+            }
+            sink += (0 == k ? _buf_ref[l % BENCH_COLS] : _buf_lut[l % BENCH_COLS]);
+        }
+        double s = (double)(_now_ns() - start) / 1e9;
+        cps[k] = ((double)lines * BENCH_COLS) / s;
+        printf("%-22s %8u lines in %7.3f s  %11.0f chars/s\n", names[k], lines, s, cps[k]);
+    }
+    printf("Speedup (table): %.2fx\n", cps[1] / cps[0]);
+    return (bad ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,68 @@
+/**
+ * Host build - Board functions.
+ *
+ * The board functions the CMT runtime uses, for the host build.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "board.h"
+#include "core1_main.h"
+
+#include "pico/stdlib.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+uint32_t now_ms() {
+    return ((uint32_t)(time_us_64() / 1000));
+}
+
+uint64_t now_us() {
+    return (time_us_64());
+}
+
+float onboard_temp_c() {
+    return (25.0f);
+}
+
+float onboard_temp_f() {
+    return (77.0f);
+}
+
+void debug_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    printf("DEBUG: ");
+    vprintf(format, args);
+    va_end(args);
+}
+
+void error_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "ERROR: ");
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void info_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void warn_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "WARN: ");
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void core1_main() {
+    // The host programs start their own core 1 loop (`multicore_launch_core1`).
+    panic("Host build - core1_main (the UI) is not available.");
+}
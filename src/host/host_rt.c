@@ -0,0 +1,268 @@
+/**
+ * Host build - Pico SDK shim (real time).
+ *
+ * The cores, time, events and alarms, built on POSIX threads and the monotonic clock.
+ *
+ *  - Each core is a thread. The program's main thread is core 0, `multicore_launch_core1`
+ *    starts a thread for core 1.
+ *  - SEV/WFE is an event flag for each core and a condition variable to wait on.
+ *  - The hardware alarms are run by an alarm thread. It calls the callbacks as core 0, in an
+ *    interrupt handler (`__get_current_exception` is non-zero), the way the alarm IRQ would.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "pico.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define _ALARM_IRQ_BASE 16      // Exception number of the first alarm IRQ (as on the RP2040)
+
+static uint64_t _boot_ns;               // Monotonic time the program started
+
+static pthread_mutex_t _event_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _event_cond;      // (uses the monotonic clock)
+static bool _event[2];                  // Event flag for each core (set by SEV, cleared by WFE)
+static int _event_waiters;
+
+typedef struct _host_alarm_ {
+    bool claimed;
+    bool armed;
+    bool forced;
+    uint64_t target;
+    hardware_alarm_callback_t callback;
+} _host_alarm_t;
+
+static _host_alarm_t _alarms[NUM_TIMERS];
+static pthread_mutex_t _alarm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _alarm_cond;      // (uses the monotonic clock)
+static pthread_t _alarm_thread;
+static bool _alarm_thread_started;
+
+static pthread_t _core1_thread;
+
+
+// ============================================
+// Internal functions
+// ============================================
+
+static uint64_t _mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec);
+}
+
+static struct timespec _abs_timespec(uint64_t us_since_boot) {
+    uint64_t ns = _boot_ns + (us_since_boot * 1000ull);
+    struct timespec ts = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    return (ts);
+}
+
+__attribute__((constructor)) static void _host_sdk_init(void) {
+    _boot_ns = _mono_ns();
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_alarm_cond, &attr);
+    pthread_cond_init(&_event_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief The alarm 'IRQ'. Waits for the earliest armed alarm (or a forced one) and calls its
+ *        callback, without holding the alarm lock (the callback sets the alarms).
+ */
+static void* _alarm_thread_main(void* arg) {
+    (void)arg;
+    host_core_num = 0;
+    pthread_mutex_lock(&_alarm_mutex);
+    while (1) {
+        int fire = -1;
+        bool timed = false;
+        uint64_t earliest = 0;
+        uint64_t now = time_us_64();
+        for (int i = 0; i < NUM_TIMERS; i++) {
+            _host_alarm_t* alarm = &_alarms[i];
+            if (alarm->forced || (alarm->armed && alarm->target <= now)) {
+                fire = i;
+                break;
+            }
+            if (alarm->armed && (!timed || alarm->target < earliest)) {
+                earliest = alarm->target;
+                timed = true;
+            }
+        }
+        if (fire >= 0) {
+            _host_alarm_t* alarm = &_alarms[fire];
+            alarm->forced = false;
+            alarm->armed = false;
+            hardware_alarm_callback_t callback = alarm->callback;
+            pthread_mutex_unlock(&_alarm_mutex);
+            if (callback) {
+                host_exception_num = _ALARM_IRQ_BASE + fire;
+                callback((uint)fire);
+                host_exception_num = 0;
+            }
+            pthread_mutex_lock(&_alarm_mutex);
+        }
+        else if (timed) {
+            struct timespec ts = _abs_timespec(earliest);
+            pthread_cond_timedwait(&_alarm_cond, &_alarm_mutex, &ts);
+        }
+        else {
+            pthread_cond_wait(&_alarm_cond, &_alarm_mutex);
+        }
+    }
+    return (NULL);
+}
+
+static void* _core1_thread_main(void* entry) {
+    host_core_num = 1;
+    ((void (*)(void))entry)();
+    return (NULL);
+}
+
+
+// ============================================
+// Public functions
+// ============================================
+
+void tight_loop_contents(void) {
+    // The cores may share a CPU on the host, let the other one run.
+    sched_yield();
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    return (0);
+}
+
+void restore_interrupts(uint32_t status) {
+    (void)status;
+}
+
+uint64_t time_us_64(void) {
+    return ((_mono_ns() - _boot_ns) / 1000ull);
+}
+
+void sleep_us(uint64_t us) {
+    struct timespec ts = { (time_t)(us / 1000000ull), (long)((us % 1000000ull) * 1000ull) };
+    while (nanosleep(&ts, &ts) && EINTR == errno) {
+    }
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t)ms * 1000ull);
+}
+
+void __sev(void) {
+    pthread_mutex_lock(&_event_mutex);
+    _event[0] = true;
+    _event[1] = true;
+    if (_event_waiters) {
+        pthread_cond_broadcast(&_event_cond);
+    }
+    pthread_mutex_unlock(&_event_mutex);
+}
+
+void __wfe(void) {
+    best_effort_wfe_or_timeout(UINT64_MAX);
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp) {
+    uint core = get_core_num();
+    bool timed_out = false;
+    pthread_mutex_lock(&_event_mutex);
+    if (!_event[core]) {
+        struct timespec ts = _abs_timespec(timeout_timestamp < UINT64_MAX / 2000 ? timeout_timestamp : UINT64_MAX / 2000);
+        _event_waiters++;
+        while (!_event[core] && !timed_out) {
+            timed_out = (ETIMEDOUT == pthread_cond_timedwait(&_event_cond, &_event_mutex, &ts));
+        }
+        _event_waiters--;
+    }
+    _event[core] = false;
+    pthread_mutex_unlock(&_event_mutex);
+    return (timed_out || time_us_64() >= timeout_timestamp);
+}
+
+int hardware_alarm_claim_unused(bool required) {
+    int alarm_num = -1;
+    pthread_mutex_lock(&_alarm_mutex);
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        if (!_alarms[i].claimed) {
+            _alarms[i].claimed = true;
+            alarm_num = i;
+            break;
+        }
+    }
+    if (alarm_num >= 0 && !_alarm_thread_started) {
+        _alarm_thread_started = true;
+        pthread_create(&_alarm_thread, NULL, _alarm_thread_main, NULL);
+    }
+    pthread_mutex_unlock(&_alarm_mutex);
+    if (alarm_num < 0 && required) {
+        panic("No hardware alarms are available");
+    }
+    return (alarm_num);
+}
+
+void hardware_alarm_unclaim(uint alarm_num) {
+    pthread_mutex_lock(&_alarm_mutex);
+    memset(&_alarms[alarm_num], 0, sizeof(_host_alarm_t));
+    pthread_mutex_unlock(&_alarm_mutex);
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback) {
+    pthread_mutex_lock(&_alarm_mutex);
+    _alarms[alarm_num].callback = callback;
+    if (!callback) {
+        _alarms[alarm_num].armed = false;
+    }
+    pthread_mutex_unlock(&_alarm_mutex);
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t) {
+    bool missed = false;
+    pthread_mutex_lock(&_alarm_mutex);
+    if (t <= time_us_64()) {
+        _alarms[alarm_num].armed = false;
+        missed = true;
+    }
+    else {
+        _alarms[alarm_num].target = t;
+        _alarms[alarm_num].armed = true;
+        pthread_cond_signal(&_alarm_cond);
+    }
+    pthread_mutex_unlock(&_alarm_mutex);
+    return (missed);
+}
+
+void hardware_alarm_cancel(uint alarm_num) {
+    pthread_mutex_lock(&_alarm_mutex);
+    _alarms[alarm_num].armed = false;
+    pthread_mutex_unlock(&_alarm_mutex);
+}
+
+void hardware_alarm_force_irq(uint alarm_num) {
+    pthread_mutex_lock(&_alarm_mutex);
+    _alarms[alarm_num].forced = true;
+    pthread_cond_signal(&_alarm_cond);
+    pthread_mutex_unlock(&_alarm_mutex);
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    if (pthread_create(&_core1_thread, NULL, _core1_thread_main, (void*)entry)) {
+        panic("Could not start the core 1 thread");
+    }
+}
@@ -0,0 +1,85 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * The parts of the Pico SDK that the CMT runtime uses, so the message loops, queues and
+ * scheduled messages can be run (and measured) on a development machine. This has the parts
+ * that are the same for the real-time build (host_rt.c) and the simulation build (host_sim.c).
+ *
+ *  - The hardware spin locks are test-and-set locks (see `hardware/sync.h`).
+ *  - The interpolators are a functional model (see `hardware/interp.h`).
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "pico.h"
+#include "hardware/interp.h"
+#include "hardware/structs/nvic.h"
+#include "hardware/sync.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+HOST_CORE_LOCAL uint host_core_num = 0;
+HOST_CORE_LOCAL uint host_exception_num = 0;
+
+nvic_hw_t host_nvic_hw;
+interp_hw_t host_interp_hw[2][2];
+
+static spin_lock_t _spin_locks[NUM_SPIN_LOCKS];
+static uint32_t _spin_locks_claimed;
+static pthread_mutex_t _claim_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+// ============================================
+// Public functions
+// ============================================
+
+void panic(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fputs("\n*** PANIC ***\n", stderr);
+    vfprintf(stderr, fmt, args);
+    fputs("\n", stderr);
+    va_end(args);
+    exit(EXIT_FAILURE);
+}
+
+spin_lock_t* spin_lock_instance(uint lock_num) {
+    return (&_spin_locks[lock_num]);
+}
+
+spin_lock_t* spin_lock_init(uint lock_num) {
+    spin_lock_t* lock = spin_lock_instance(lock_num);
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+    return (lock);
+}
+
+int spin_lock_claim_unused(bool required) {
+    int lock_num = -1;
+    pthread_mutex_lock(&_claim_mutex);
+    for (int i = 0; i < NUM_SPIN_LOCKS; i++) {
+        if (!(_spin_locks_claimed & (1u << i))) {
+            _spin_locks_claimed |= (1u << i);
+            lock_num = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_claim_mutex);
+    if (lock_num < 0 && required) {
+        panic("No spin locks are available");
+    }
+    return (lock_num);
+}
+
+void spin_lock_unclaim(uint lock_num) {
+    pthread_mutex_lock(&_claim_mutex);
+    _spin_locks_claimed &= ~(1u << lock_num);
+    pthread_mutex_unlock(&_claim_mutex);
+}
+
+uint spin_get_lock_num(spin_lock_t* lock) {
+    return ((uint)(lock - _spin_locks));
+}
@@ -0,0 +1,405 @@
+/**
+ * Host build - Pico SDK shim (simulation).
+ *
+ * The cores, time, events and alarms, as a discrete event simulation on virtual time.
+ *
+ *  - Core 0 (the program's main context), core 1 and the alarm 'IRQ' are contexts (ucontext)
+ *    that take turns on a single thread. Switches only happen at the scheduling points (reading
+ *    the time, SEV, WFE, spinning), and the next to run is picked with a seeded generator.
+ *  - The alarm 'IRQ' is taken as soon as an alarm is due, unless core 0 has its interrupts
+ *    disabled. Core 0 doesn't run while a callback is running (it is 'interrupted').
+ *  - Time only moves when a core spins (1us), works (`host_sim_work_us`), or when nothing can
+ *    run (it jumps to the next WFE timeout or alarm).
+ *
+ * See the host_sim.h header for more information.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "host_sim.h"
+
+#include "pico.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#define _ALARM_IRQ_BASE 16      // Exception number of the first alarm IRQ (as on the RP2040)
+#define _STACK_SIZE (256 * 1024)
+
+#define _CNTX_CORE0 0
+#define _CNTX_CORE1 1
+#define _CNTX_IRQ 2
+#define _CNTX_CNT 3
+
+typedef struct _sim_cntx_ {
+    ucontext_t uc;
+    bool started;
+    bool waiting;                       // In WFE (or working) until `wake_us`
+    bool working;                       // Waiting for `wake_us` only (an event doesn't end it)
+    uint64_t wake_us;
+    uint exception_num;                 // `__get_current_exception` value while it runs
+} _sim_cntx_t;
+
+typedef struct _sim_alarm_ {
+    bool claimed;
+    bool armed;
+    bool forced;
+    uint64_t target;
+    hardware_alarm_callback_t callback;
+} _sim_alarm_t;
+
+static uint64_t _now_us;                // The virtual time
+static int _current = _CNTX_CORE0;      // The context running
+static _sim_cntx_t _cntx[_CNTX_CNT];
+static bool _event[2];                  // Event flag for each core (set by SEV, cleared by WFE)
+static bool _irq_disabled[2];
+static bool _irq_active;                // The IRQ is running a callback (core 0 is interrupted)
+static _sim_alarm_t _alarms[NUM_TIMERS];
+static void (*_core1_entry)(void);
+
+static uint64_t _rng = 1;
+static uint64_t _hash = 0xcbf29ce484222325ull; // (FNV-1a offset basis)
+static uint64_t _switches;
+static uint64_t _end_us;
+static void (*_end_fn)(void);
+static bool _ended;                     // The end time was reached (the ending context runs on its own)
+
+
+// ============================================
+// Internal functions
+// ============================================
+
+static uint32_t _random(void) {
+    // xorshift64*
+    _rng ^= _rng >> 12;
+    _rng ^= _rng << 25;
+    _rng ^= _rng >> 27;
+    return ((uint32_t)((_rng * 0x2545f4914f6cdd1dull) >> 32));
+}
+
+static void _hash_add(uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        _hash ^= (value & 0xff);
+        _hash *= 0x100000001b3ull;      // (FNV prime)
+        value >>= 8;
+    }
+}
+
+__attribute__((constructor)) static void _host_sim_init(void) {
+    const char* seed = getenv("CMT_SIM_SEED");
+    host_sim_seed(seed ? strtoull(seed, NULL, 0) : 1);
+    _cntx[_CNTX_CORE0].started = true;
+}
+
+static void _time_set(uint64_t us) {
+    if (!_ended && _end_us && us >= _end_us) {
+        // The end function reads the time (a scheduling point), so mark the run as ended
+        // first. The other contexts don't run again, so it only runs once.
+        _now_us = _end_us;
+        _end_us = 0;
+        _ended = true;
+        if (_end_fn) {
+            _end_fn();
+        }
+        exit(EXIT_SUCCESS);
+    }
+    _now_us = us;
+}
+
+static int _alarm_due(void) {
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        if (_alarms[i].forced || (_alarms[i].armed && _alarms[i].target <= _now_us)) {
+            return (i);
+        }
+    }
+    return (-1);
+}
+
+static bool _core_runnable(int c) {
+    const _sim_cntx_t* cntx = &_cntx[c];
+    if (!cntx->started || (c == _CNTX_CORE0 && _irq_active)) {
+        return (false);
+    }
+    return (!cntx->waiting || (!cntx->working && _event[c]) || _now_us >= cntx->wake_us);
+}
+
+/**
+ * @brief Pick the context to run next.
+ *
+ * @return The context, or -1 if none can run.
+ */
+static int _pick(void) {
+    if (!_irq_active && !_irq_disabled[0] && _alarm_due() >= 0) {
+        return (_CNTX_IRQ); // The alarm interrupt is taken right away
+    }
+    int candidates[2];
+    int cnt = 0;
+    if (_irq_active) {
+        candidates[cnt++] = _CNTX_IRQ;
+    }
+    for (int c = _CNTX_CORE0; c <= _CNTX_CORE1; c++) {
+        if (_core_runnable(c)) {
+            candidates[cnt++] = c;
+        }
+    }
+    if (cnt == 0) {
+        return (-1);
+    }
+    return (cnt == 1 ? candidates[0] : candidates[_random() % cnt]);
+}
+
+/**
+ * @brief Move the time to the next WFE timeout, work end, or alarm (nothing can run until then).
+ */
+static void _time_advance(void) {
+    bool found = false;
+    uint64_t next = 0;
+    for (int c = _CNTX_CORE0; c <= _CNTX_CORE1; c++) {
+        const _sim_cntx_t* cntx = &_cntx[c];
+        if (cntx->started && cntx->waiting && (!found || cntx->wake_us < next)) {
+            next = cntx->wake_us;
+            found = true;
+        }
+    }
+    if (!_irq_disabled[0]) {
+        for (int i = 0; i < NUM_TIMERS; i++) {
+            if (_alarms[i].armed && (!found || _alarms[i].target < next)) {
+                next = _alarms[i].target;
+                found = true;
+            }
+        }
+    }
+    if (!found) {
+        panic("Simulation - Nothing can run and nothing is scheduled (time: %llu us).", (unsigned long long)_now_us);
+    }
+    _time_set(next > _now_us ? next : _now_us);
+}
+
+static void _switch(int next) {
+    int prev = _current;
+    _cntx[prev].exception_num = host_exception_num;
+    _current = next;
+    host_core_num = (next == _CNTX_CORE1 ? 1 : 0);
+    host_exception_num = _cntx[next].exception_num;
+    _switches++;
+    _hash_add(((uint64_t)next << 56) | _now_us);
+    swapcontext(&_cntx[prev].uc, &_cntx[next].uc);
+}
+
+/**
+ * @brief Scheduling point. Let the next context (which can be the calling one) run.
+ */
+static void _schedule(void) {
+    if (_ended) {
+        return; // (the ending context keeps running)
+    }
+    while (1) {
+        int next = _pick();
+        if (next >= 0) {
+            if (next != _current) {
+                _switch(next);
+            }
+            return;
+        }
+        _time_advance();
+    }
+}
+
+/**
+ * @brief Wait until a time (and, unless `working`, an event).
+ *
+ * @return true if the time was reached.
+ */
+static bool _wait(uint64_t until_us, bool working) {
+    _sim_cntx_t* cntx = &_cntx[_current];
+    if (_ended) {
+        if (until_us > _now_us) {
+            _time_set(until_us);
+        }
+        return (true);
+    }
+    cntx->waiting = true;
+    cntx->working = working;
+    cntx->wake_us = until_us;
+    _schedule();
+    cntx->waiting = false;
+    cntx->working = false;
+    return (_now_us >= until_us);
+}
+
+static void _core1_main(void) {
+    _core1_entry();
+    panic("Simulation - Core 1 returned.");
+}
+
+static void _irq_main(void) {
+    while (1) {
+        int alarm_num = _alarm_due();
+        if (alarm_num >= 0) {
+            _sim_alarm_t* alarm = &_alarms[alarm_num];
+            alarm->forced = false;
+            alarm->armed = false;
+            if (alarm->callback) {
+                _irq_active = true;
+                host_exception_num = _ALARM_IRQ_BASE + alarm_num;
+                alarm->callback((uint)alarm_num);
+                host_exception_num = 0;
+                _irq_active = false;
+                _event[0] = true; // Taking an interrupt ends a WFE
+            }
+        }
+        _schedule();
+    }
+}
+
+static void _cntx_make(int c, void (*fn)(void)) {
+    _sim_cntx_t* cntx = &_cntx[c];
+    getcontext(&cntx->uc);
+    cntx->uc.uc_stack.ss_sp = malloc(_STACK_SIZE);
+    cntx->uc.uc_stack.ss_size = _STACK_SIZE;
+    cntx->uc.uc_link = NULL;
+    if (!cntx->uc.uc_stack.ss_sp) {
+        panic("Simulation - No memory for a context stack.");
+    }
+    makecontext(&cntx->uc, fn, 0);
+}
+
+
+// ============================================
+// Public functions
+// ============================================
+
+void host_sim_seed(uint64_t seed) {
+    _rng = (seed ? seed : 1);
+}
+
+void host_sim_work_us(uint64_t us) {
+    _wait(_now_us + us, true);
+}
+
+void host_sim_end_set(uint64_t end_us, void (*end_fn)(void)) {
+    _end_us = end_us;
+    _end_fn = end_fn;
+}
+
+uint64_t host_sim_hash(void) {
+    return (_hash);
+}
+
+uint64_t host_sim_switches(void) {
+    return (_switches);
+}
+
+void tight_loop_contents(void) {
+    _time_set(_now_us + 1);
+    _schedule();
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    uint core = get_core_num();
+    uint32_t saved = _irq_disabled[core];
+    _irq_disabled[core] = true;
+    return (saved);
+}
+
+void restore_interrupts(uint32_t status) {
+    _irq_disabled[get_core_num()] = (status != 0);
+    if (!status) {
+        _schedule(); // A pending alarm can be taken now
+    }
+}
+
+uint64_t time_us_64(void) {
+    _schedule();
+    return (_now_us);
+}
+
+void sleep_us(uint64_t us) {
+    host_sim_work_us(us);
+}
+
+void sleep_ms(uint32_t ms) {
+    host_sim_work_us((uint64_t)ms * 1000ull);
+}
+
+void __sev(void) {
+    _event[0] = true;
+    _event[1] = true;
+    _schedule();
+}
+
+void __wfe(void) {
+    best_effort_wfe_or_timeout(UINT64_MAX);
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp) {
+    uint core = get_core_num();
+    if (_current == _CNTX_IRQ) {
+        return (_now_us >= timeout_timestamp); // (an interrupt handler doesn't wait)
+    }
+    if (!_event[core]) {
+        _wait(timeout_timestamp, false);
+    }
+    _event[core] = false;
+    return (_now_us >= timeout_timestamp);
+}
+
+int hardware_alarm_claim_unused(bool required) {
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        if (!_alarms[i].claimed) {
+            _alarms[i].claimed = true;
+            if (!_cntx[_CNTX_IRQ].started) {
+                _cntx_make(_CNTX_IRQ, _irq_main);
+                _cntx[_CNTX_IRQ].started = true;
+            }
+            return (i);
+        }
+    }
+    if (required) {
+        panic("No hardware alarms are available");
+    }
+    return (-1);
+}
+
+void hardware_alarm_unclaim(uint alarm_num) {
+    memset(&_alarms[alarm_num], 0, sizeof(_sim_alarm_t));
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback) {
+    _alarms[alarm_num].callback = callback;
+    if (!callback) {
+        _alarms[alarm_num].armed = false;
+    }
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t) {
+    if (t <= _now_us) {
+        _alarms[alarm_num].armed = false;
+        return (true);
+    }
+    _alarms[alarm_num].target = t;
+    _alarms[alarm_num].armed = true;
+    return (false);
+}
+
+void hardware_alarm_cancel(uint alarm_num) {
+    _alarms[alarm_num].armed = false;
+}
+
+void hardware_alarm_force_irq(uint alarm_num) {
+    _alarms[alarm_num].forced = true;
+    _schedule();
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    _core1_entry = entry;
+    _cntx_make(_CNTX_CORE1, _core1_main);
+    _cntx[_CNTX_CORE1].started = true;
+}
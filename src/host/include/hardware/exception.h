@@ -0,0 +1,13 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_EXCEPTION_H_
+#define _HOST_HARDWARE_EXCEPTION_H_
+
+#include "pico.h"
+
+#endif // _HOST_HARDWARE_EXCEPTION_H_
@@ -0,0 +1,106 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * A functional model of the interpolators (two for each core), for checking code that uses
+ * them against plain C. A lane result is the lane's accumulator (the other lane's with
+ * CROSS_INPUT) shifted right, masked (sign-extended with SIGNED) and added to the lane's base
+ * (or the shifted value added with ADD_RAW). CROSS_RESULT, FORCE_MSB, BLEND, CLAMP, the
+ * 'full' result and POP are not modelled.
+ *
+ * The accumulators, bases and results are `uintptr_t` (32 bits on the RP2040), so a lane can
+ * add an offset to a host pointer.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_INTERP_H_
+#define _HOST_HARDWARE_INTERP_H_
+
+#include "pico.h"
+
+#include <stdint.h>
+
+#define SIO_INTERP0_CTRL_LANE0_SHIFT_LSB 0
+#define SIO_INTERP0_CTRL_LANE0_SHIFT_BITS 0x0000001fu
+#define SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB 5
+#define SIO_INTERP0_CTRL_LANE0_MASK_LSB_BITS 0x000003e0u
+#define SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB 10
+#define SIO_INTERP0_CTRL_LANE0_MASK_MSB_BITS 0x00007c00u
+#define SIO_INTERP0_CTRL_LANE0_SIGNED_BITS 0x00008000u
+#define SIO_INTERP0_CTRL_LANE0_CROSS_INPUT_BITS 0x00010000u
+#define SIO_INTERP0_CTRL_LANE0_ADD_RAW_BITS 0x00040000u
+
+typedef struct {
+    uintptr_t accum[2];
+    uintptr_t base[3];
+    uint32_t ctrl[2];
+} interp_hw_t;
+
+typedef struct {
+    uint32_t ctrl;
+} interp_config;
+
+extern interp_hw_t host_interp_hw[2][2];        // [core][interpolator]
+
+#define interp0 (&host_interp_hw[get_core_num()][0])
+#define interp1 (&host_interp_hw[get_core_num()][1])
+
+static inline interp_config interp_default_config(void) {
+    interp_config c = { .ctrl = (31u << SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB) };
+    return (c);
+}
+
+static inline void interp_config_set_shift(interp_config* c, uint shift) {
+    c->ctrl = (c->ctrl & ~SIO_INTERP0_CTRL_LANE0_SHIFT_BITS) | (shift << SIO_INTERP0_CTRL_LANE0_SHIFT_LSB);
+}
+
+static inline void interp_config_set_mask(interp_config* c, uint mask_lsb, uint mask_msb) {
+    c->ctrl = (c->ctrl & ~(SIO_INTERP0_CTRL_LANE0_MASK_LSB_BITS | SIO_INTERP0_CTRL_LANE0_MASK_MSB_BITS))
+        | (mask_lsb << SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB) | (mask_msb << SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB);
+}
+
+static inline void interp_config_set_signed(interp_config* c, bool _signed) {
+    c->ctrl = (c->ctrl & ~SIO_INTERP0_CTRL_LANE0_SIGNED_BITS) | (_signed ? SIO_INTERP0_CTRL_LANE0_SIGNED_BITS : 0);
+}
+
+static inline void interp_config_set_cross_input(interp_config* c, bool cross_input) {
+    c->ctrl = (c->ctrl & ~SIO_INTERP0_CTRL_LANE0_CROSS_INPUT_BITS) | (cross_input ? SIO_INTERP0_CTRL_LANE0_CROSS_INPUT_BITS : 0);
+}
+
+static inline void interp_config_set_add_raw(interp_config* c, bool add_raw) {
+    c->ctrl = (c->ctrl & ~SIO_INTERP0_CTRL_LANE0_ADD_RAW_BITS) | (add_raw ? SIO_INTERP0_CTRL_LANE0_ADD_RAW_BITS : 0);
+}
+
+static inline void interp_set_config(interp_hw_t* interp, uint lane, interp_config* config) {
+    interp->ctrl[lane] = config->ctrl;
+}
+
+static inline void interp_set_base(interp_hw_t* interp, uint lane, uintptr_t val) {
+    interp->base[lane] = val;
+}
+
+static inline void interp_set_accumulator(interp_hw_t* interp, uint lane, uintptr_t val) {
+    interp->accum[lane] = val;
+}
+
+static inline uintptr_t interp_peek_lane_result(interp_hw_t* interp, uint lane) {
+    uint32_t ctrl = interp->ctrl[lane];
+    uint shift = (ctrl & SIO_INTERP0_CTRL_LANE0_SHIFT_BITS) >> SIO_INTERP0_CTRL_LANE0_SHIFT_LSB;
+    uint mask_lsb = (ctrl & SIO_INTERP0_CTRL_LANE0_MASK_LSB_BITS) >> SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB;
+    uint mask_msb = (ctrl & SIO_INTERP0_CTRL_LANE0_MASK_MSB_BITS) >> SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB;
+    uint32_t input = (uint32_t)interp->accum[(ctrl & SIO_INTERP0_CTRL_LANE0_CROSS_INPUT_BITS) ? lane ^ 1 : lane];
+    uint32_t shifted = input >> shift;
+    if (ctrl & SIO_INTERP0_CTRL_LANE0_ADD_RAW_BITS) {
+        return (interp->base[lane] + shifted);
+    }
+    uint32_t mask = (0xffffffffu >> (31 - mask_msb)) & ~((1u << mask_lsb) - 1u);
+    uint32_t masked = shifted & mask;
+    if ((ctrl & SIO_INTERP0_CTRL_LANE0_SIGNED_BITS) && (masked & (1u << mask_msb))) {
+        masked |= ~((2u << mask_msb) - 1u); // (sign-extend from the MSB of the mask)
+        return (interp->base[lane] + (uintptr_t)(intptr_t)(int32_t)masked);
+    }
+    return (interp->base[lane] + masked);
+}
+
+#endif // _HOST_HARDWARE_INTERP_H_
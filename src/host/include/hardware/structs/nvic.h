@@ -0,0 +1,24 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_STRUCTS_NVIC_H_
+#define _HOST_HARDWARE_STRUCTS_NVIC_H_
+
+#include "pico.h"
+
+typedef struct {
+    volatile uint32_t iser;
+    volatile uint32_t icer;
+    volatile uint32_t ispr;
+    volatile uint32_t icpr;
+} nvic_hw_t;
+
+extern nvic_hw_t host_nvic_hw;
+
+#define nvic_hw (&host_nvic_hw)
+
+#endif // _HOST_HARDWARE_STRUCTS_NVIC_H_
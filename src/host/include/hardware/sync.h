@@ -0,0 +1,65 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * The hardware spin locks are test-and-set locks. The event (SEV/WFE) is a flag per core
+ * with a condition variable to wait on.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_SYNC_H_
+#define _HOST_HARDWARE_SYNC_H_
+
+#include "pico.h"
+
+#define NUM_SPIN_LOCKS 32
+
+typedef volatile uint32_t spin_lock_t;
+
+static inline void __dmb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __mem_fence_acquire(void) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void __mem_fence_release(void) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+extern void __sev(void);
+extern void __wfe(void);
+
+/**
+ * @brief Disable the interrupts of the calling core.
+ *
+ * This only matters to the simulation build, where the alarm 'IRQ' isn't taken on core 0 while
+ * its interrupts are disabled (for example, while it holds a spin lock).
+ *
+ * @return The previous state (for `restore_interrupts`).
+ */
+extern uint32_t save_and_disable_interrupts(void);
+extern void restore_interrupts(uint32_t status);
+
+extern spin_lock_t* spin_lock_instance(uint lock_num);
+extern spin_lock_t* spin_lock_init(uint lock_num);
+extern int spin_lock_claim_unused(bool required);
+extern void spin_lock_unclaim(uint lock_num);
+extern uint spin_get_lock_num(spin_lock_t* lock);
+
+static inline uint32_t spin_lock_blocking(spin_lock_t* lock) {
+    uint32_t saved_irq = save_and_disable_interrupts();
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        tight_loop_contents();
+    }
+    return (saved_irq);
+}
+
+static inline void spin_unlock(spin_lock_t* lock, uint32_t saved_irq) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+    restore_interrupts(saved_irq);
+}
+
+#endif // _HOST_HARDWARE_SYNC_H_
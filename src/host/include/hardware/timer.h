@@ -0,0 +1,36 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * The time is `CLOCK_MONOTONIC` since the program started. The hardware alarms are run by
+ * an alarm thread, which calls the callbacks as core 0 in an interrupt handler.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_HARDWARE_TIMER_H_
+#define _HOST_HARDWARE_TIMER_H_
+
+#include "pico.h"
+
+#define NUM_TIMERS 4
+
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+extern uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void) {
+    return ((uint32_t)time_us_64());
+}
+
+extern int hardware_alarm_claim_unused(bool required);
+extern void hardware_alarm_unclaim(uint alarm_num);
+extern void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+/**
+ * @return true if the target time has already passed (the alarm was not set).
+ */
+extern bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t);
+extern void hardware_alarm_cancel(uint alarm_num);
+extern void hardware_alarm_force_irq(uint alarm_num);
+
+#endif // _HOST_HARDWARE_TIMER_H_
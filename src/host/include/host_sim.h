@@ -0,0 +1,97 @@
+/**
+ * Host build - Virtual time simulation.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_SIM_H_
+#define _HOST_SIM_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pico/types.h"
+
+/**
+ * @file host_sim.h
+ * @defgroup host_sim host_sim
+ * Discrete event simulation of the CMT runtime (the `CMT_HOST_SIM` build).
+ *
+ * Both cores and the alarm 'IRQ' run on one thread, and take turns at the points where the
+ * runtime reads the time, waits for an event (WFE), signals one (SEV), or spins (a spin lock,
+ * or a full queue). At each of those points the next to run is picked with a seeded random
+ * number generator, so a seed always gives the same interleaving.
+ *
+ * Time is virtual. It stands still while code runs, moves 1us each time a core spins, and
+ * jumps ahead to the next WFE timeout or alarm when no core can run. An hour of scheduled
+ * messages and sleep continuations runs in a few seconds (or less), the same way each time.
+ * Use `host_sim_work_us` to give code a run time.
+ *
+ * The alarm 'IRQ' is taken on core 0 (when its interrupts aren't disabled) as soon as an alarm
+ * is due, so core 0 doesn't run while a callback is running, but core 1 does.
+ *
+ * The seed is from `CMT_SIM_SEED` in the environment (1 if it isn't set) unless it is set by
+ * `host_sim_seed`.
+ *
+ * @addtogroup host_sim
+ * @include host_sim.c
+ *
+*/
+
+/**
+ * @brief Set the seed for the choice of which core (or the IRQ) runs next.
+ * @ingroup host_sim
+ *
+ * Call it before starting core 1 for a run to be repeatable.
+ *
+ * @param seed The seed (0 is changed to 1).
+ */
+extern void host_sim_seed(uint64_t seed);
+
+/**
+ * @brief Have the calling core take (virtual) time, as if it was doing work.
+ * @ingroup host_sim
+ *
+ * The other core (and the IRQ) can run in the meantime.
+ *
+ * @param us The time the work takes.
+ */
+extern void host_sim_work_us(uint64_t us);
+
+/**
+ * @brief Set the time to end the simulation.
+ * @ingroup host_sim
+ *
+ * When the virtual time reaches `end_us` the end function is called (from the core or IRQ that
+ * was running) and then the program exits with `EXIT_SUCCESS`. It is called once: from then on
+ * no other context runs (a wait just moves the time).
+ *
+ * @param end_us The virtual time (us since the start) to end at.
+ * @param end_fn Function to call at the end (for reporting), or NULL.
+ */
+extern void host_sim_end_set(uint64_t end_us, void (*end_fn)(void));
+
+/**
+ * @brief A hash of the run so far (which ran after which, and when).
+ * @ingroup host_sim
+ *
+ * Two runs with the same seed and workload have the same hash. A different hash means the
+ * scheduling changed.
+ *
+ * @return The hash.
+ */
+extern uint64_t host_sim_hash(void);
+
+/**
+ * @brief The number of switches between the cores and the IRQ so far.
+ * @ingroup host_sim
+ *
+ * @return The number of switches.
+ */
+extern uint64_t host_sim_switches(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _HOST_SIM_H_
@@ -0,0 +1,19 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * The parts of the Pico SDK (`pico.h`) that the CMT runtime uses, for the host build.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_H_
+#define _HOST_PICO_H_
+
+#include "pico/types.h"
+#include "pico/platform.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#endif // _HOST_PICO_H_
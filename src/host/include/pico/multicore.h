@@ -0,0 +1,17 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * Core 1 is a thread (with `get_core_num` returning 1). The program's main thread is core 0.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_MULTICORE_H_
+#define _HOST_PICO_MULTICORE_H_
+
+#include "pico.h"
+
+extern void multicore_launch_core1(void (*entry)(void));
+
+#endif // _HOST_PICO_MULTICORE_H_
@@ -0,0 +1,46 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * Each thread that stands in for a core has its core number (`get_core_num`). The alarm
+ * thread runs the alarm callbacks as core 0 'in an interrupt handler'
+ * (`__get_current_exception` is non-zero).
+ *
+ * In the simulation build (`CMT_HOST_SIM`) the cores and the alarm 'IRQ' take turns on a single
+ * thread, and the simulator sets the values as it switches between them.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_PLATFORM_H_
+#define _HOST_PICO_PLATFORM_H_
+
+#include "pico/types.h"
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+
+#if CMT_HOST_SIM
+#define HOST_CORE_LOCAL
+#else
+#define HOST_CORE_LOCAL _Thread_local
+#endif
+
+extern HOST_CORE_LOCAL uint host_core_num;
+extern HOST_CORE_LOCAL uint host_exception_num;
+
+static inline uint get_core_num(void) {
+    return (host_core_num);
+}
+
+static inline uint __get_current_exception(void) {
+    return (host_exception_num);
+}
+
+extern void panic(const char* fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+extern void tight_loop_contents(void);
+
+#endif // _HOST_PICO_PLATFORM_H_
@@ -0,0 +1,13 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_STDIO_H_
+#define _HOST_PICO_STDIO_H_
+
+#include <stdio.h>
+
+#endif // _HOST_PICO_STDIO_H_
@@ -0,0 +1,19 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_STDLIB_H_
+#define _HOST_PICO_STDLIB_H_
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#endif // _HOST_PICO_STDLIB_H_
@@ -0,0 +1,40 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_TIME_H_
+#define _HOST_PICO_TIME_H_
+
+#include "pico/types.h"
+#include "hardware/timer.h"
+
+static inline absolute_time_t get_absolute_time(void) {
+    return (time_us_64());
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return (time_us_64() + us);
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return (time_us_64() + ((uint64_t)ms * 1000));
+}
+
+static inline uint32_t us_to_ms(uint64_t us) {
+    return ((uint32_t)(us / 1000));
+}
+
+/**
+ * @brief Wait for an event (a SEV from either core) or for the time to be reached.
+ *
+ * @return true if the time was reached.
+ */
+extern bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp);
+
+extern void sleep_us(uint64_t us);
+extern void sleep_ms(uint32_t ms);
+
+#endif // _HOST_PICO_TIME_H_
@@ -0,0 +1,38 @@
+/**
+ * Host build - Pico SDK shim.
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#ifndef _HOST_PICO_TYPES_H_
+#define _HOST_PICO_TYPES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+/** @brief Absolute time (microseconds since boot - since the program started on the host). */
+typedef uint64_t absolute_time_t;
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return (t);
+}
+
+static inline absolute_time_t from_us_since_boot(uint64_t us) {
+    return (us);
+}
+
+typedef struct {
+    int16_t year;
+    int8_t month;
+    int8_t day;
+    int8_t dotw;
+    int8_t hour;
+    int8_t min;
+    int8_t sec;
+} datetime_t;
+
+#endif // _HOST_PICO_TYPES_H_
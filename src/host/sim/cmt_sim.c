@@ -0,0 +1,554 @@
+/**
+ * CMT Simulation (host simulation build).
+ *
+ * Runs a workload on the CMT runtime in virtual time (see host_sim.h) and reports how well
+ * the scheduled messages, sleep continuations and cross-core messages kept to their times.
+ * With the same seed the results (and the run hash) are the same each run, so they can be
+ * compared across changes to the runtime.
+ *
+ * The workload:
+ *  - Core 0: The Backend's test cycle (`_handle_be_test`), a repeating 60 second scheduled
+ *    message, checked for its error from the ideal time.
+ *  - Core 0: A chain of 250ms `cmt_sleep_ms` continuations (each schedules the next).
+ *  - Core 1: A 10ms repeating scheduled message, whose handler posts a message to core 0.
+ *    Core 0 handles those (taking 200us of work for each).
+ *  - Core 1: A coroutine that waits 100ms, works for 1ms, and repeats.
+ *  - An idle task on each core (core 0's takes 50us of work).
+ *
+ * Before the workload starts, core 0 checks its own queue (with nothing taking messages from
+ * it): each overflow policy (the drop and eviction counts, and the order of the messages that
+ * are left), coalescing (a stand-in is delivered once, with the last value, even after it has
+ * been evicted or replaced), the priority and deadline order, and that payloads are released
+ * after an eviction and can't be scheduled. It then posts messages with payloads to itself,
+ * and checks that they were released once its message loop has handled them. A failed check
+ * is printed, and the program exits with `EXIT_FAILURE` at the end.
+ *
+ *   cmt_sim [seconds (3600)] [seed (CMT_SIM_SEED or 1)]
+ *
+ * With `CMT_SIM_TRACE` set in the environment, the trace (see cmt_trace.h) is dumped at the end
+ * (for `cmt_trace_json`).
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "cmt.h"
+#include "cmt_co.h"
+#include "cmt_trace.h"
+#include "host_sim.h"
+#include "msg_payload.h"
+#include "multicore.h"
+
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MSG_SIM_CYCLE MSG_BE_TEST               // core 0 (60 second cycle)
+#define MSG_SIM_DATA MSG_UI_INITIALIZED         // core 1 -> core 0
+#define MSG_SIM_TICK MSG_BE_INITIALIZED         // core 1 (10ms)
+#define MSG_SIM_PAYLOAD MSG_DISPLAY_MESSAGE     // core 0 (payload check)
+#define MSG_SIM_CHECK_A MSG_COMMON_NOOP         // (queue checks - not handled)
+#define MSG_SIM_CHECK_B MSG_BACKEND_NOOP        // (queue checks - not handled)
+
+#define SIM_SECONDS_DEFAULT 3600
+#define SIM_CYCLE_MS (60 * 1000)
+#define SIM_SLEEP_MS 250
+#define SIM_TICK_MS 10
+#define SIM_DATA_WORK_US 200
+#define SIM_CO_MS 100
+#define SIM_CO_WORK_US 1000
+#define SIM_PAYLOAD_MSGS 4
+#define SIM_CHECK_MSGS_MAX 64
+
+typedef struct _sim_timing_ {
+    uint32_t count;
+    int64_t err_max_us;                         // Latest compared to the ideal time
+    int64_t err_min_us;                         // Earliest compared to the ideal time
+} _sim_timing_t;
+
+static _sim_timing_t _cycle;
+static _sim_timing_t _sleep;
+static _sim_timing_t _data;                     // (time from the post to the handler)
+static _sim_timing_t _co;
+static uint32_t _idle_runs[2];
+static cmt_sm_handle_t _cycle_handle = CMT_SM_HANDLE_INVALID;
+static cmt_sm_handle_t _tick_handle = CMT_SM_HANDLE_INVALID;
+static uint64_t _cycle_first_us;
+static uint64_t _sleep_due_us;
+static cmt_co_t _co_1;
+static clock_t _wall_start;
+static uint32_t _checks_passed;
+static uint32_t _checks_failed;
+static uint32_t _payloads_handled;
+
+
+// ============================================
+// Internal functions
+// ============================================
+
+static void _timing_add(_sim_timing_t* timing, int64_t err_us) {
+    if (timing->count == 0 || err_us > timing->err_max_us) {
+        timing->err_max_us = err_us;
+    }
+    if (timing->count == 0 || err_us < timing->err_min_us) {
+        timing->err_min_us = err_us;
+    }
+    timing->count++;
+}
+
+static void _timing_print(const char* label, const _sim_timing_t* timing) {
+    printf("%-26s %8u  error (us) min %6lld  max %6lld\n", label, timing->count,
+        (long long)timing->err_min_us, (long long)timing->err_max_us);
+}
+
+static void _check(bool ok, const char* what) {
+    if (ok) {
+        _checks_passed++;
+    }
+    else {
+        _checks_failed++;
+        printf("Check failed: %s\n", what);
+    }
+}
+
+static void _sim_end(void) {
+    double wall = (double)(clock() - _wall_start) / CLOCKS_PER_SEC;
+    printf("Virtual time %.0f s in %.3f s (CPU)\n", (double)time_us_64() / 1e6, wall);
+    _timing_print("Core 0 - 60s cycle:", &_cycle);
+    printf("%-26s %8u\n", "Core 0 - 60s cycle missed:", scheduled_msg_handle_missed(_cycle_handle));
+    _timing_print("Core 0 - 250ms sleep:", &_sleep);
+    _timing_print("Core 0 - data from core 1:", &_data);
+    printf("%-26s %8u\n", "Core 1 - 10ms tick missed:", scheduled_msg_handle_missed(_tick_handle));
+    _timing_print("Core 1 - coroutine:", &_co);
+    printf("%-26s %8u  %8u\n", "Idle task runs (0, 1):", _idle_runs[0], _idle_runs[1]);
+    printf("%-26s %8u  failed %u\n", "Checks passed:", _checks_passed, _checks_failed);
+    printf("Switches %llu  Hash %016llx\n", (unsigned long long)host_sim_switches(), (unsigned long long)host_sim_hash());
+    if (getenv("CMT_SIM_TRACE")) {
+        cmt_trace_dump();
+    }
+    if (_checks_failed) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+// ============================================
+// Queue checks (core 0, before its message loop runs)
+// ============================================
+
+/**
+ * @brief Post a numbered message to core 0 (the number is in `data.ts_ms`).
+ */
+static bool _check_post(msg_id_t id, uint32_t n, bool block) {
+    cmt_msg_t msg = { id };
+    msg.data.ts_ms = n;
+    if (block) {
+        post_to_core0_blocking(&msg);
+        return (true);
+    }
+    return (post_to_core0_nowait(&msg));
+}
+
+/**
+ * @brief Take all of the messages waiting for core 0 (releasing their payloads, as the
+ *        message loop does).
+ *
+ * @return The number taken (only the first `max` are kept).
+ */
+static int _check_drain(cmt_msg_t* msgs, int max) {
+    int count = 0;
+    cmt_msg_t msg;
+    while (get_core0_msg_nowait(&msg)) {
+        if (count < max) {
+            msgs[count] = msg;
+        }
+        count++;
+        cmt_msg_payload_release(&msg, 0);
+    }
+    return (count);
+}
+
+/**
+ * @brief Check that the messages taken are numbered `first` to `first + count - 1`.
+ */
+static bool _check_run(const cmt_msg_t* msgs, int count, uint32_t first) {
+    for (int i = 0; i < count; i++) {
+        if (msgs[i].data.ts_ms != first + (uint32_t)i) {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+static void _check_stats_delta(const cmt_queue_stats_t* before, cmt_queue_stats_t* delta) {
+    core_queue_stats(0, delta);
+    delta->posted -= before->posted;
+    delta->dropped -= before->dropped;
+    delta->evicted -= before->evicted;
+    delta->coalesced -= before->coalesced;
+    delta->blocked -= before->blocked;
+    delta->timeouts -= before->timeouts;
+}
+
+/**
+ * @brief Check each overflow policy.
+ *
+ * @return The depth of the queue (found by the drop newest check).
+ */
+static int _check_overflow(void) {
+    static cmt_msg_t msgs[SIM_CHECK_MSGS_MAX];
+    cmt_queue_stats_t before, delta;
+    int depth = 0;
+
+    // Drop newest: the queue fills, then the new messages are dropped
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_DROP_NEWEST, 0);
+    core_queue_stats(0, &before);
+    while (depth < SIM_CHECK_MSGS_MAX && _check_post(MSG_SIM_CHECK_A, (uint32_t)depth, false)) {
+        depth++;
+    }
+    _check(depth > 2 && depth < SIM_CHECK_MSGS_MAX, "drop newest: the queue fills");
+    _check(!_check_post(MSG_SIM_CHECK_A, depth + 1, false), "drop newest: a post to a full queue fails");
+    _check_post(MSG_SIM_CHECK_A, depth + 2, true); // (dropped too - it doesn't wait)
+    _check_stats_delta(&before, &delta);
+    _check(delta.posted == (uint32_t)depth && delta.dropped == 3 && delta.evicted == 0, "drop newest: counts");
+    int count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == depth && _check_run(msgs, count, 0), "drop newest: the first messages are left, in order");
+
+    // Block (with a timeout): a blocking post waits, times out, and is dropped
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_BLOCK, 100);
+    core_queue_stats(0, &before);
+    for (int i = 0; i < depth; i++) {
+        _check_post(MSG_SIM_CHECK_A, (uint32_t)i, true);
+    }
+    _check(!_check_post(MSG_SIM_CHECK_A, depth, false), "block: a non-blocking post to a full queue fails");
+    _check_post(MSG_SIM_CHECK_A, depth + 1, true); // (nothing takes them, so it times out)
+    _check_stats_delta(&before, &delta);
+    _check(delta.posted == (uint32_t)depth && delta.dropped == 2 && delta.blocked == 1 && delta.timeouts == 1,
+        "block: counts");
+    count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == depth && _check_run(msgs, count, 0), "block: the first messages are left, in order");
+
+    // Drop oldest: each new message evicts the oldest waiting one
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_DROP_OLDEST, 0);
+    core_queue_stats(0, &before);
+    for (int i = 0; i < depth + 4; i++) {
+        _check_post(MSG_SIM_CHECK_A, (uint32_t)i, false);
+    }
+    _check_stats_delta(&before, &delta);
+    _check(delta.posted == (uint32_t)(depth + 4) && delta.dropped == 0 && delta.evicted == 4, "drop oldest: counts");
+    count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == depth && _check_run(msgs, count, 4), "drop oldest: the newest messages are left, in order");
+
+    // Coalesce: a new message replaces the newest waiting one with its ID (keeping its place),
+    // else the oldest waiting message is evicted
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_COALESCE, 0);
+    core_queue_stats(0, &before);
+    for (int i = 0; i < depth + 2; i++) {
+        _check_post(MSG_SIM_CHECK_A, (uint32_t)i, false);
+    }
+    _check_post(MSG_SIM_CHECK_B, 1000, false);
+    _check_stats_delta(&before, &delta);
+    _check(delta.posted == (uint32_t)(depth + 3) && delta.coalesced == 2 && delta.evicted == 1 && delta.dropped == 0,
+        "coalesce: counts");
+    count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == depth && _check_run(msgs, depth - 3, 1)
+        && msgs[depth - 2].id == MSG_SIM_CHECK_A && msgs[depth - 2].data.ts_ms == (uint32_t)(depth + 1)
+        && msgs[depth - 1].id == MSG_SIM_CHECK_B, "coalesce: replaced in place, oldest evicted, in order");
+
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_BLOCK, 0);
+    return (depth);
+}
+
+/**
+ * @brief Check that coalesced messages are delivered once (with the last value), including
+ *        after their stand-in has been evicted or replaced.
+ */
+static void _check_coalesce(int depth) {
+    static cmt_msg_t msgs[SIM_CHECK_MSGS_MAX];
+    cmt_queue_stats_t before, delta;
+
+    core_msg_coalesce_set(MSG_SIM_CHECK_B, true);
+    core_queue_stats(0, &before);
+    for (uint32_t i = 1; i <= 3; i++) {
+        _check_post(MSG_SIM_CHECK_B, i, false);
+    }
+    _check_stats_delta(&before, &delta);
+    _check(delta.posted == 3 && delta.coalesced == 2, "coalescible: counts");
+    int count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == 1 && msgs[0].id == MSG_SIM_CHECK_B && msgs[0].data.ts_ms == 3
+        && !(msgs[0].flags & CMT_MSG_F_COALESCED), "coalescible: delivered once, with the last value");
+
+    // Evict the stand-in (drop oldest). Its ID is then not pending, so the next post is delivered.
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_DROP_OLDEST, 0);
+    _check_post(MSG_SIM_CHECK_B, 10, false);
+    _check_post(MSG_SIM_CHECK_B, 11, false); // (merged into it)
+    for (int i = 0; i < depth; i++) {
+        _check_post(MSG_SIM_CHECK_A, (uint32_t)i, false);
+    }
+    count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == depth && _check_run(msgs, count, 0), "coalescible: the stand-in is evicted");
+    _check_post(MSG_SIM_CHECK_B, 12, false);
+    count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == 1 && msgs[0].id == MSG_SIM_CHECK_B && msgs[0].data.ts_ms == 12,
+        "coalescible: delivered once after an eviction");
+
+    // Replace the stand-in (coalesce) with a message of its ID that isn't coalesced (it has a
+    // payload). The ID is then not pending, so the next post is delivered.
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_COALESCE, 0);
+    _check_post(MSG_SIM_CHECK_B, 20, false);
+    for (int i = 0; i < depth - 1; i++) {
+        _check_post(MSG_SIM_CHECK_A, (uint32_t)i, false);
+    }
+    cmt_msg_t msg = { MSG_SIM_CHECK_B };
+    cmt_msg_payload_alloc(&msg, 8, CMT_PAYLOAD_CORE0);
+    post_to_core0_nowait(&msg);
+    count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == depth && msgs[0].id == MSG_SIM_CHECK_B && (msgs[0].flags & CMT_MSG_F_PAYLOAD)
+        && _check_run(&msgs[1], depth - 1, 0), "coalescible: the stand-in is replaced");
+    _check_post(MSG_SIM_CHECK_B, 21, false);
+    count = _check_drain(msgs, SIM_CHECK_MSGS_MAX);
+    _check(count == 1 && msgs[0].id == MSG_SIM_CHECK_B && msgs[0].data.ts_ms == 21,
+        "coalescible: delivered once after being replaced");
+
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_BLOCK, 0);
+    core_msg_coalesce_set(MSG_SIM_CHECK_B, false);
+}
+
+/**
+ * @brief Check the order messages are taken in: urgent, then normal, then bulk, and within
+ *        a class the earliest deadline first (then the order posted).
+ */
+static void _check_priority(void) {
+    static const struct { uint8_t prio; uint32_t deadline_us; } posts[] = {
+        { CMT_MSG_PRIO_NORMAL, 0 },
+        { CMT_MSG_PRIO_BULK, 0 },
+        { CMT_MSG_PRIO_URGENT, 0 },
+        { CMT_MSG_PRIO_NORMAL, 20000 },
+        { CMT_MSG_PRIO_NORMAL, 10000 },
+        { CMT_MSG_PRIO_URGENT, 0 },
+    };
+    static const uint32_t order[] = { 2, 5, 4, 3, 0, 1 };
+    cmt_msg_t msgs[6];
+
+    for (uint32_t i = 0; i < 6; i++) {
+        cmt_msg_t msg = { MSG_SIM_CHECK_A, posts[i].prio };
+        msg.data.ts_ms = i;
+        if (posts[i].deadline_us) {
+            cmt_msg_deadline_set(&msg, posts[i].deadline_us);
+        }
+        post_to_core0_blocking(&msg);
+    }
+    int count = _check_drain(msgs, 6);
+    bool ok = (count == 6);
+    for (int i = 0; ok && i < 6; i++) {
+        ok = (msgs[i].data.ts_ms == order[i]);
+    }
+    _check(ok, "priority: urgent, normal (earliest deadline first), bulk");
+}
+
+/**
+ * @brief Check that payloads are released when their messages are evicted (and taken), and
+ *        that a message with a payload can't be scheduled.
+ */
+static void _check_payload(int depth) {
+    static cmt_msg_t msgs[SIM_CHECK_MSGS_MAX];
+
+    _check(0 == cmt_msg_payload_in_use(0), "payload: none in use to start");
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_DROP_OLDEST, 0);
+    uint32_t one = 0;
+    for (int i = 0; i < depth + 2; i++) {
+        cmt_msg_t msg = { MSG_SIM_CHECK_A };
+        cmt_msg_payload_alloc(&msg, 8, CMT_PAYLOAD_CORE0);
+        if (0 == i) {
+            one = cmt_msg_payload_in_use(0);
+        }
+        post_to_core0_nowait(&msg);
+    }
+    _check(cmt_msg_payload_in_use(0) == one * (uint32_t)depth, "payload: released when evicted");
+    _check(_check_drain(msgs, SIM_CHECK_MSGS_MAX) == depth && 0 == cmt_msg_payload_in_use(0),
+        "payload: released when taken");
+    core_queue_overflow_set(0, CMT_QUEUE_OVF_BLOCK, 0);
+
+    cmt_msg_t msg = { MSG_SIM_CHECK_A };
+    cmt_msg_payload_alloc(&msg, 8, CMT_PAYLOAD_CORE0);
+    _check(CMT_SM_HANDLE_INVALID == schedule_msg_in_ms(10, &msg), "payload: can't be scheduled");
+    cmt_msg_payload_release(&msg, 0);
+    _check(0 == cmt_msg_payload_in_use(0), "payload: none in use at the end");
+}
+
+/**
+ * @brief Check the queues of core 0 (before its message loop runs), and post the messages
+ *        with payloads for the message loop to handle.
+ */
+static void _checks_run(void) {
+    int depth = _check_overflow();
+    _check_coalesce(depth);
+    _check_priority();
+    _check_payload(depth);
+    for (int i = 0; i < SIM_PAYLOAD_MSGS; i++) {
+        char str[16];
+        cmt_msg_t msg = { MSG_SIM_PAYLOAD };
+        snprintf(str, sizeof(str), "payload %d", i);
+        cmt_msg_payload_str(&msg, str, CMT_PAYLOAD_CORE0);
+        post_to_core0_blocking(&msg);
+    }
+}
+
+
+// ============================================
+// Coroutines, idle functions and sleep functions
+// ============================================
+
+static cmt_co_result_t _co_1_run(cmt_co_t* co) {
+    static uint64_t due;
+    CMT_CO_BEGIN(co);
+    while (1) {
+        due = time_us_64() + (SIM_CO_MS * 1000);
+        CMT_CO_AWAIT_SLEEP(co, SIM_CO_MS);
+        _timing_add(&_co, (int64_t)(time_us_64() - due));
+        host_sim_work_us(SIM_CO_WORK_US);
+    }
+    CMT_CO_END(co);
+}
+
+static void _idle_0(void) {
+    _idle_runs[0]++;
+    host_sim_work_us(50);
+}
+
+static void _idle_1(void) {
+    _idle_runs[1]++;
+}
+
+static void _sleep_continue(void* user_data) {
+    _timing_add(&_sleep, (int64_t)(time_us_64() - _sleep_due_us));
+    _sleep_due_us = time_us_64() + (SIM_SLEEP_MS * 1000);
+    cmt_sleep_ms(SIM_SLEEP_MS, _sleep_continue, user_data);
+}
+
+
+// ============================================
+// Message handler functions
+// ============================================
+
+static void _handle_cycle(cmt_msg_t* msg) {
+    static uint32_t times;
+    uint64_t now = time_us_64();
+    if (CMT_SM_HANDLE_INVALID == _cycle_handle) {
+        // First time - start the repeating message and the other work. The payload messages
+        // were posted before this one, so they have been handled (and released).
+        _check(SIM_PAYLOAD_MSGS == _payloads_handled && 0 == cmt_msg_payload_in_use(0),
+            "payload: released after the handlers run");
+        cmt_msg_t msg_cycle = { MSG_SIM_CYCLE };
+        _cycle_handle = schedule_msg_every_ms(SIM_CYCLE_MS, &msg_cycle);
+        _cycle_first_us = now;
+        _sleep_due_us = now + (SIM_SLEEP_MS * 1000);
+        cmt_sleep_ms(SIM_SLEEP_MS, _sleep_continue, NULL);
+        return;
+    }
+    times++;
+    _timing_add(&_cycle, (int64_t)(now - (_cycle_first_us + ((uint64_t)times * SIM_CYCLE_MS * 1000))));
+}
+
+static void _handle_data(cmt_msg_t* msg) {
+    _timing_add(&_data, (int64_t)(time_us_64() - msg->data.ts_us));
+    host_sim_work_us(SIM_DATA_WORK_US);
+}
+
+static void _handle_payload(cmt_msg_t* msg) {
+    char str[16];
+    snprintf(str, sizeof(str), "payload %u", (unsigned)_payloads_handled);
+    const char* payload = cmt_msg_payload(msg);
+    _check(payload && 0 == strcmp(payload, str), "payload: delivered with its data");
+    _payloads_handled++;
+}
+
+static void _handle_tick(cmt_msg_t* msg) {
+    if (CMT_SM_HANDLE_INVALID == _tick_handle) {
+        // First time - start the repeating message and the coroutine
+        cmt_msg_t msg_tick = { MSG_SIM_TICK };
+        _tick_handle = schedule_msg_every_ms(SIM_TICK_MS, &msg_tick);
+        cmt_co_start(&_co_1, _co_1_run, NULL);
+        return;
+    }
+    cmt_msg_t data = { MSG_SIM_DATA };
+    data.data.ts_us = time_us_64();
+    post_to_core0_blocking(&data);
+}
+
+static void _handle_cmt_sleep(cmt_msg_t* msg) {
+    cmt_handle_sleep(msg);
+}
+
+static const msg_handler_entry_t _cycle_handler_entry = { MSG_SIM_CYCLE, _handle_cycle };
+static const msg_handler_entry_t _data_handler_entry = { MSG_SIM_DATA, _handle_data };
+static const msg_handler_entry_t _payload_handler_entry = { MSG_SIM_PAYLOAD, _handle_payload };
+static const msg_handler_entry_t _tick_handler_entry = { MSG_SIM_TICK, _handle_tick };
+static const msg_handler_entry_t _cmt_sleep_handler_entry = { MSG_CMT_SLEEP, _handle_cmt_sleep };
+
+static const msg_handler_entry_t* _core0_handler_entries[] = {
+    &_cycle_handler_entry,
+    &_data_handler_entry,
+    &_payload_handler_entry,
+    &_cmt_sleep_handler_entry,
+    ((msg_handler_entry_t*)0), // Last entry must be a NULL
+};
+
+static const msg_handler_entry_t* _core1_handler_entries[] = {
+    &_tick_handler_entry,
+    &_cmt_sleep_handler_entry,
+    ((msg_handler_entry_t*)0), // Last entry must be a NULL
+};
+
+static const idle_task_entry_t _idle_task_0 = { _idle_0, (20 * 1000), 50 };
+static const idle_task_entry_t _idle_task_1 = { _idle_1, (100 * 1000), 100 };
+
+static const idle_task_entry_t* _core0_idle_tasks[] = {
+    &_idle_task_0,
+    ((idle_task_entry_t*)0), // Last entry must be a NULL
+};
+
+static const idle_task_entry_t* _core1_idle_tasks[] = {
+    &_idle_task_1,
+    ((idle_task_entry_t*)0), // Last entry must be a NULL
+};
+
+static const msg_loop_cntx_t _core0_loop_cntx = { 0, _core0_handler_entries, _core0_idle_tasks };
+static const msg_loop_cntx_t _core1_loop_cntx = { 1, _core1_handler_entries, _core1_idle_tasks };
+
+static void _core1_main(void) {
+    cmt_msg_t msg = { MSG_SIM_TICK };
+    post_to_core1_blocking(&msg);
+    message_loop(&_core1_loop_cntx);
+}
+
+
+// ============================================
+// Main
+// ============================================
+
+int main(int argc, char** argv) {
+    uint64_t seconds = SIM_SECONDS_DEFAULT;
+    if (argc > 1) {
+        seconds = strtoull(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        host_sim_seed(strtoull(argv[2], NULL, 0));
+    }
+    printf("CMT simulation (%llu seconds)\n", (unsigned long long)seconds);
+    _wall_start = clock();
+    host_sim_end_set(seconds * 1000 * 1000, _sim_end);
+
+    multicore_module_init();
+    _checks_run();
+    multicore_launch_core1(_core1_main);
+    cmt_msg_t msg = { MSG_SIM_CYCLE };
+    post_to_core0_blocking(&msg);
+    message_loop(&_core0_loop_cntx);
+
+    return (0);
+}
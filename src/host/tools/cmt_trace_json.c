@@ -0,0 +1,168 @@
+/**
+ * CMT Trace to Chrome/Perfetto trace JSON.
+ *
+ * Reads a trace dump (`cmt_trace_dump`) from stdin (lines before the dump, for example other
+ * console output, are skipped) and writes Chrome trace event JSON to stdout. The result can
+ * be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Each core is a process, with a thread for its message loop and one for its interrupts.
+ * Handlers, idle tasks, interrupts and SPI transfers are slices. Posts, drops, messages
+ * taken from the queue, and the start and end of SPI DMA transfers (which are recorded on
+ * different threads) are instant events.
+ *
+ *   cmt_trace_json < console.log > trace.json
+ *
+ * Copyright 2023 AESilky
+ * SPDX-License-Identifier: MIT License
+ *
+*/
+#include "cmt_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _LINE_MAX 256
+
+static bool _first = true;
+
+static void _event_begin(const char* ph, uint64_t ts, int ring) {
+    printf("%s\n{\"ph\":\"%s\",\"ts\":%llu,\"pid\":%d,\"tid\":%d", (_first ? "" : ","), ph,
+        (unsigned long long)ts, ring >> 1, ring & 1);
+    _first = false;
+}
+
+static void _meta_print(void) {
+    for (int core = 0; core < 2; core++) {
+        _event_begin("M", 0, core << 1);
+        printf(",\"name\":\"process_name\",\"args\":{\"name\":\"Core %d\"}}", core);
+        for (int irq = 0; irq < 2; irq++) {
+            _event_begin("M", 0, (core << 1) | irq);
+            printf(",\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}", (irq ? "IRQ" : "Loop"));
+        }
+    }
+}
+
+static const char* _isr_src_name(unsigned src) {
+    switch (src) {
+        case CMT_TRACE_ISR_SRC_IRQ:
+            return ("irq");
+        case CMT_TRACE_ISR_SRC_ALARM:
+            return ("alarm");
+        case CMT_TRACE_ISR_SRC_GPIO:
+            return ("gpio");
+        default:
+            return ("isr");
+    }
+}
+
+/**
+ * @brief Write an event.
+ *
+ * @param depth Open slices of the ring. An end with none open (its start was overwritten
+ *              in the ring) is skipped.
+ */
+static void _event_print(const cmt_trace_event_t* event, uint64_t ts, int ring, int* depth) {
+    switch (event->type) {
+        case CMT_TRACE_POST:
+        case CMT_TRACE_POST_DROP:
+            _event_begin("i", ts, ring);
+            printf(",\"s\":\"t\",\"name\":\"%s 0x%04x\",\"args\":{\"to_core\":%u}}",
+                (CMT_TRACE_POST == event->type ? "post" : "DROP"), event->b, event->a);
+            break;
+        case CMT_TRACE_TAKE:
+            _event_begin("i", ts, ring);
+            printf(",\"s\":\"t\",\"name\":\"take 0x%04x\",\"args\":{\"batch\":%u}}", event->b, event->a);
+            break;
+        case CMT_TRACE_HANDLER_START:
+            _event_begin("B", ts, ring);
+            printf(",\"name\":\"msg 0x%04x\",\"args\":{\"handler\":%u}}", event->b, event->a);
+            (*depth)++;
+            break;
+        case CMT_TRACE_IDLE_START:
+            _event_begin("B", ts, ring);
+            printf(",\"name\":\"idle %u\"}", event->a);
+            (*depth)++;
+            break;
+        case CMT_TRACE_ISR_ENTER:
+            _event_begin("B", ts, ring);
+            printf(",\"name\":\"%s %u\",\"args\":{\"detail\":%u}}", _isr_src_name(CMT_TRACE_ISR_SRC(event->b)),
+                event->a, CMT_TRACE_ISR_DETAIL(event->b));
+            (*depth)++;
+            break;
+        case CMT_TRACE_SPI_START:
+            _event_begin("B", ts, ring);
+            printf(",\"name\":\"spi%u\",\"args\":{\"bytes\":%u}}", event->a, event->b);
+            (*depth)++;
+            break;
+        case CMT_TRACE_HANDLER_END:
+        case CMT_TRACE_IDLE_END:
+        case CMT_TRACE_ISR_EXIT:
+        case CMT_TRACE_SPI_END:
+            if (*depth > 0) {
+                _event_begin("E", ts, ring);
+                printf("}");
+                (*depth)--;
+            }
+            break;
+        case CMT_TRACE_SPI_DMA_START:
+        case CMT_TRACE_SPI_DMA_END:
+            _event_begin("i", ts, ring);
+            printf(",\"s\":\"p\",\"name\":\"spi%u dma %s\",\"args\":{\"bytes\":%u}}", event->a,
+                (CMT_TRACE_SPI_DMA_START == event->type ? "start" : "end"), event->b);
+            break;
+        case CMT_TRACE_MARK:
+            _event_begin("i", ts, ring);
+            printf(",\"s\":\"p\",\"name\":\"mark %u\",\"args\":{\"b\":%u}}", event->a, event->b);
+            break;
+        default:
+            break;
+    }
+}
+
+int main(int argc, char** argv) {
+    char line[_LINE_MAX];
+    bool in_dump = false;
+    int ring = -1;
+    int depth = 0;
+    bool have_t = false;
+    uint32_t last_t = 0;
+    uint64_t ts = 0;
+    unsigned long events = 0;
+
+    printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    _meta_print();
+    while (fgets(line, sizeof(line), stdin)) {
+        if (!in_dump) {
+            in_dump = (0 == strncmp(line, "#CMT-TRACE 2", 12));
+            continue;
+        }
+        if (0 == strncmp(line, "#END", 4)) {
+            break;
+        }
+        if ('@' == line[0]) {
+            // A new ring. Times are extended to 64 bits (through `time_us_32` wraps) per ring.
+            ring = atoi(&line[1]);
+            depth = 0;
+            have_t = false;
+            continue;
+        }
+        unsigned int t, type, a, b;
+        if (ring < 0 || ring >= CMT_TRACE_RINGS || 4 != sscanf(line, "%8x%2x%2x%4x", &t, &type, &a, &b)) {
+            continue;
+        }
+        cmt_trace_event_t event = { t, (uint8_t)type, (uint8_t)a, (uint16_t)b };
+        ts = (have_t ? ts + (uint32_t)(event.t - last_t) : event.t);
+        last_t = event.t;
+        have_t = true;
+        _event_print(&event, ts, ring, &depth);
+        events++;
+    }
+    printf("\n]}\n");
+    if (!in_dump) {
+        fprintf(stderr, "cmt_trace_json: No trace dump found.\n");
+        return (EXIT_FAILURE);
+    }
+    fprintf(stderr, "cmt_trace_json: %lu events.\n", events);
+    return (EXIT_SUCCESS);
+}
@@ -10,13 +10,97 @@
 */
 #include "system_defs.h"
 #include "spi_ops.h"
+#include "cmt_trace.h"
+
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+static int _dma_chan = -1;                      // DMA channel for the SPI writes
+static spin_lock_t* _dma_lock;                  // Lock to claim the DMA channel (either core)
+static spi_inst_t* volatile _dma_spi = NULL;    // SPI a DMA write is running on (NULL = none)
+static size_t _dma_len;
+static spi_dma_done_fn _dma_done;
+static void* _dma_user_data;
+
+// ============================================
+// Internal functions
+// ============================================
+
+/**
+ * Set the number of bits in a frame. The SPI must be idle.
+*/
+static inline void _frame_bits(spi_inst_t* spi, uint bits) {
+    hw_write_masked(&spi_get_hw(spi)->cr0, (bits - 1) << SPI_SSPCR0_DSS_LSB, SPI_SSPCR0_DSS_BITS);
+}
+
+static inline uint16_t _trace_len(size_t len) {
+    return (len < 0xffff ? (uint16_t)len : 0xffff);
+}
+
+/**
+ * DMA interrupt handler. Finishes a DMA write once the SPI has shifted out the
+ * last of the data (the DMA is done when the last word is in the TX FIFO), and then
+ * releases the SPI.
+*/
+static void _dma_irq_handler(void) {
+    if (_dma_chan < 0 || !dma_channel_get_irq0_status((uint)_dma_chan)) {
+        return; // (shared handler - not ours)
+    }
+    dma_channel_acknowledge_irq0((uint)_dma_chan);
+    spi_inst_t* spi = _dma_spi;
+    cmt_trace(CMT_TRACE_ISR_ENTER, DMA_IRQ_0, CMT_TRACE_ISR_B(CMT_TRACE_ISR_SRC_IRQ, 0));
+    // The DMA is done once the last word is in the TX FIFO, so what is left to shift out is at
+    // most the FIFO (8 frames) plus the frame in the shift register: 9 x 16 bits, which is 8us at
+    // the display's 18MHz (18us at the touch's 8MHz). That is short enough to wait for here.
+    while (spi_is_busy(spi)) {
+        tight_loop_contents();
+    }
+    // Nothing was reading while the DMA wrote, so empty the RX FIFO and clear the overrun.
+    while (spi_is_readable(spi)) {
+        (void)spi_get_hw(spi)->dr;
+    }
+    spi_get_hw(spi)->icr = SPI_SSPICR_RORIC_BITS;
+    _frame_bits(spi, 8);
+    cmt_trace(CMT_TRACE_SPI_DMA_END, (uint8_t)spi_get_index(spi), _trace_len(_dma_len * 2));
+    // Finish the operation before the SPI is released. `spi_begin` (on either core) waits for
+    // the release, so the next operation can't start (and change the chip select, or the
+    // state of the operation) while it is being finished.
+    if (_dma_done) {
+        _dma_done(_dma_user_data);
+    }
+    _dma_spi = NULL;
+    cmt_trace(CMT_TRACE_ISR_EXIT, DMA_IRQ_0, CMT_TRACE_ISR_B(CMT_TRACE_ISR_SRC_IRQ, 0));
+}
+
+// ============================================
+// Public functions
+// ============================================
+
+/**
+ * Initialize the SPI operations (the SPIs must already be initialized).
+ *
+ * Claims the DMA channel used for the 16-bit writes. The DMA interrupt is
+ * handled on the core that calls this.
+*/
+void spi_ops_module_init(void) {
+    _dma_lock = spin_lock_init(spin_lock_claim_unused(true));
+    _dma_chan = dma_claim_unused_channel(true);
+    dma_channel_set_irq0_enabled((uint)_dma_chan, true);
+    irq_add_shared_handler(DMA_IRQ_0, _dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
 
 /**
  * Make sure we have control of the SPI for one or more operations.
  * `spi_end` must be called when the SPI is done being used.
+ *
+ * Waits for a DMA write on the SPI to finish.
 */
 void spi_begin(spi_inst_t* spi) {
-
+    while (_dma_spi == spi) {
+        tight_loop_contents();
+    }
 }
 
 /**
@@ -29,22 +113,83 @@ void spi_end(spi_inst_t* spi) {
 }
 
 int spi_read(spi_inst_t* spi, uint8_t txv, uint8_t* dst, size_t len) {
-    return (spi_read_blocking(spi, txv, dst, len));
+    cmt_trace(CMT_TRACE_SPI_START, (uint8_t)spi_get_index(spi), _trace_len(len));
+    int retval = spi_read_blocking(spi, txv, dst, len);
+    cmt_trace(CMT_TRACE_SPI_END, (uint8_t)spi_get_index(spi), _trace_len(len));
+    return (retval);
 }
 
 int spi_write(spi_inst_t* spi, const uint8_t* data, size_t len) {
-    return (spi_write_blocking(spi, data, len));
+    cmt_trace(CMT_TRACE_SPI_START, (uint8_t)spi_get_index(spi), _trace_len(len));
+    int retval = spi_write_blocking(spi, data, len);
+    cmt_trace(CMT_TRACE_SPI_END, (uint8_t)spi_get_index(spi), _trace_len(len));
+    return (retval);
 }
 
+/**
+ * Write 16-bit values (MSB first, as 16-bit frames).
+*/
 int spi_write16(spi_inst_t* spi, const uint16_t* data, size_t len) {
-    for (int i = 0; i < len; i++) {
-        uint8_t bytes[] = {(*data & 0xff00) >> 8, *data & 0xff};
-        spi_write_blocking(spi, bytes, 2);
-        data++;
-    }
+    cmt_trace(CMT_TRACE_SPI_START, (uint8_t)spi_get_index(spi), _trace_len(len * 2));
+    _frame_bits(spi, 16);
+    spi_write16_blocking(spi, data, len); // (returns once the SPI is idle)
+    _frame_bits(spi, 8);
+    cmt_trace(CMT_TRACE_SPI_END, (uint8_t)spi_get_index(spi), _trace_len(len * 2));
     return (len);
 }
 
+/**
+ * Start a DMA write of 16-bit values (MSB first, as 16-bit frames) and return.
+ *
+ * The data must stay valid until the write is done. `done` (if not NULL) is called
+ * from the DMA interrupt when it is, before the SPI is released (`spi_begin` waits
+ * until it has returned).
+ *
+ * Either core can call this. The channel is claimed under a spin lock, so only one of them
+ * can start a write.
+ *
+ * @return false if a DMA write is already running (nothing is started).
+*/
+bool spi_write16_dma(spi_inst_t* spi, const uint16_t* data, size_t len, spi_dma_done_fn done, void* user_data) {
+    uint32_t flags = spin_lock_blocking(_dma_lock);
+    bool busy = (_dma_spi != NULL);
+    if (!busy && len) {
+        _dma_spi = spi;
+    }
+    spin_unlock(_dma_lock, flags);
+    if (busy) {
+        return (false);
+    }
+    if (0 == len) {
+        if (done) {
+            done(user_data);
+        }
+        return (true);
+    }
+    _dma_len = len;
+    _dma_done = done;
+    _dma_user_data = user_data;
+    cmt_trace(CMT_TRACE_SPI_DMA_START, (uint8_t)spi_get_index(spi), _trace_len(len * 2));
+    _frame_bits(spi, 16);
+    dma_channel_config c = dma_channel_get_default_config((uint)_dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_dreq(&c, spi_get_dreq(spi, true));
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure((uint)_dma_chan, &c, &spi_get_hw(spi)->dr, data, len, true);
+    return (true);
+}
+
+bool spi_dma_busy(void) {
+    return (_dma_spi != NULL);
+}
+
+void spi_dma_wait(void) {
+    while (_dma_spi) {
+        tight_loop_contents();
+    }
+}
+
 void spi_display_begin() {
     spi_begin(SPI_DISPLAY_DEVICE);
 }
@@ -62,7 +207,11 @@ int spi_display_write(const uint8_t* data, size_t len) {
 }
 
 int spi_display_write16(const uint16_t* data, size_t len) {
-    return (spi_write16(SPI_DISPLAY_DEVICE, data, len)); // ZZZ!!! TODO: Use DMA
+    return (spi_write16(SPI_DISPLAY_DEVICE, data, len));
+}
+
+bool spi_display_write16_dma(const uint16_t* data, size_t len, spi_dma_done_fn done, void* user_data) {
+    return (spi_write16_dma(SPI_DISPLAY_DEVICE, data, len, done, user_data));
 }
 
 void spi_tsd_begin() {
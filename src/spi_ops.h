@@ -12,6 +12,13 @@
  * These functions allow the SPIs
  * to be read/writen in a coordinated way.
  *
+ * 16-bit data (display pixels and coordinates) is sent with the SPI set to 16-bit frames, so
+ * the FIFO is fed a word at a time rather than a byte at a time. A 16-bit write can also be
+ * streamed by DMA (`spi_write16_dma`), which returns right away and calls a function from the
+ * DMA interrupt once the last bit has been shifted out. There is a single DMA channel for the
+ * SPIs, so one DMA write runs at a time. Either core can start one (the channel is claimed under
+ * a spin lock). `spi_begin` waits for a DMA write on the SPI to finish.
+ *
  * Copyright 2023 AESilky
  * SPDX-License-Identifier: MIT License
  *
@@ -25,6 +32,19 @@
 #include <stdbool.h>
 #include "hardware/spi.h"
 
+/**
+ * @brief Function called (from the DMA interrupt) when a DMA write has finished.
+ *
+ * The SPI is idle and back to 8-bit frames when it is called. It is called before the SPI is
+ * released, so `spi_begin` (on either core) doesn't return until it has finished. It can't
+ * start another DMA write.
+ *
+ * @param user_data The value passed to `spi_write16_dma`.
+ */
+typedef void (*spi_dma_done_fn)(void* user_data);
+
+void spi_ops_module_init(void);
+
 void spi_begin(spi_inst_t* spi);
 void spi_display_begin(void);
 void spi_tsd_begin(void);
@@ -45,6 +65,11 @@ int spi_write16(spi_inst_t* spi, const uint16_t* data, size_t len);
 int spi_display_write16(const uint16_t* data, size_t len);
 int spi_tsd_write16(const uint16_t* data, size_t len);
 
+bool spi_write16_dma(spi_inst_t* spi, const uint16_t* data, size_t len, spi_dma_done_fn done, void* user_data);
+bool spi_display_write16_dma(const uint16_t* data, size_t len, spi_dma_done_fn done, void* user_data);
+bool spi_dma_busy(void);
+void spi_dma_wait(void);
+
 #ifdef __cplusplus
  }
 #endif
@@ -100,8 +100,9 @@ typedef struct _screen_ctx {
     const font_info_t* font_info;       // Font info for the selected font
     uint8_t* full_screen_text;          // Buffer for a full screen of characters
     colorbyte_t* full_screen_color;     // Buffer for a full screen of colors
-    bool* dirty_text_lines;             // bool array to track lines modified since paint
-    rgb16_t* render_buf;                // buffer large enough to render one line of characters into
+    uint32_t* dirty_cells;              // bitmap of the cells modified since paint (`dirty_line_words` for each line)
+    uint16_t dirty_line_words;          // Words of `dirty_cells` for each line
+    rgb16_t* strip_buf[2];              // buffers for a strip of pixel rows of a line of characters (one is rendered while the other is sent)
 } screen_ctx_t;
 
 /**
@@ -341,6 +342,10 @@ extern void disp_line_paint(uint16_t line);
  * To improve performance and the look of the display, most changes can be made without
  * updating the physical display. Then, once a batch of changes have been made, this
  * is called to move the screen/image buffer onto the display.
+ *
+ * Only the characters changed since the last paint are painted (each run of adjacent
+ * changed characters on a line as one area of the screen). Showing, hiding and moving
+ * the cursor marks the characters it was and is on as changed.
  */
 extern void disp_paint(void);
 
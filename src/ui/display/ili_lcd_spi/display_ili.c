@@ -9,11 +9,24 @@
 #include "display_i.h"
 #include "font.h"
 #include "font_10_16.h"
+#include "glyph_render.h"
 #include "ili_lcd_spi.h"
 #include "board.h"
 #include "debug.h"
 #include "string.h"
 
+#ifndef DISP_STRIP_ROWS
+#define DISP_STRIP_ROWS 1       // Pixel rows of a full line in a strip buffer (a shorter run fits more rows)
+#endif
+
+#ifndef DISP_GLYPH_INTERP
+#define DISP_GLYPH_INTERP 0     // Render glyph rows with the interpolators (see glyph_render.h)
+#endif
+
+static void _disp_cells_paint(uint16_t aline, uint16_t col, uint16_t ncols);
+static void _dirty_cells_mark(uint16_t aline, uint16_t col, uint16_t ncols);
+static void _dirty_cells_paint(uint16_t aline);
+static void _dirty_cursor_mark(void);
 static void _disp_char(uint16_t aline, uint16_t col, char c, paint_control_t paint);
 static void _disp_char_colorbyte(uint16_t aline, uint16_t col, char c, uint8_t color, paint_control_t paint);
 static void _disp_line_clear(uint16_t aline, paint_control_t paint);
@@ -42,6 +55,9 @@ static const rgb16_t _color16_map[] = {
     ILI_BR_WHITE
 };
 
+/** @brief Pixel pairs for each color-byte (for `_color16_map`) */
+static glyph_lut_t _glyph_lut;
+
 /** @brief The current/active screen context */
 static screen_ctx_t* _scr_ctx = NULL;
 
@@ -78,9 +94,6 @@ static char _disp_char_get(uint16_t aline, uint16_t col) {
  * Display an ASCII character (plus some special characters)
  * If the top bit is set (c>127) the character is inverse (black on white background).
  *
- * Getting the glyph data for the font character is similar to `disp_line_paint`,
- * but the difference is that here we are rendering one single complete charcter.
- *
  * NOTE: This does not perform text line translation, nor bounds check.
  *
  */
@@ -89,57 +102,10 @@ static void _disp_char_colorbyte(uint16_t aline, uint16_t col, char c, uint8_t c
     *(_scr_ctx->full_screen_color + (aline * _scr_ctx->cols) + col) = color;
     if (paint) {
         // Actually render the characher glyph onto the screen.
-        bool invert = c & DISP_CHAR_INVERT_BIT;
-        unsigned char cl = c & 0x7F;
-        uint8_t fg = (invert ? bg_from_cb(color) : fg_from_cb(color));
-        uint8_t bg = (invert ? fg_from_cb(color) : bg_from_cb(color));
-        rgb16_t fgrgb = rgb16_from_color16(fg);
-        rgb16_t bgrgb = rgb16_from_color16(bg);
-        const font_info_t* fi = _scr_ctx->font_info;
-        int8_t font_height = fi->height;
-        int8_t font_width = fi->width;
-        int8_t bpgl = fi->bytes_per_glyph_line;
-        rgb16_t* rbuf = _scr_ctx->render_buf;
-        uint16_t glyphindex = (cl * font_height * bpgl);
-        // See if we need to show the cursor
-        bool show_a_cursor = (_scr_ctx->show_cursor && col == _scr_ctx->cursor_pos.column && aline == _translate_cursor_line(_scr_ctx->cursor_pos.line));
-        rgb16_t cursor_color = _scr_ctx->cursor_color;
-        for (int glyph_line = 0; glyph_line < font_height; glyph_line++) {
-            if (show_a_cursor && glyph_line == _scr_ctx->font_info->suggested_cursor_line) {
-                for (int c = 0; c < font_width; c++) {
-                    *rbuf++ = cursor_color;
-                }
-            }
-            else {
-                // Get each glyph row for the character (each line of the font char height).
-                uint32_t cgr = 0;
-                uint32_t mask = 1u << (font_width - 1u);
-                for (int byte = 0; byte < bpgl; byte++) {
-                    cgr |= (fi->glyphs[glyphindex + byte + (glyph_line * bpgl)]) << (8u * byte);
-                }
-                for (int c = 0; c < font_width; c++) {
-                    // For each glyph column bit that is set, set the forground color in the character buffer.
-                    if (cgr & mask) {
-                        *rbuf = fgrgb;
-                    }
-                    else {
-                        *rbuf = bgrgb;
-                    }
-                    mask >>= 1u;
-                    rbuf++;
-                }
-            }
-        }
-        // Set a window into the right part of the screen
-        uint16_t x = col * font_width;
-        uint16_t y = aline * font_height;
-        uint16_t w = font_width;
-        uint16_t h = font_height;
-        ili_window_set_area(x, y, w, h);
-        ili_screen_paint(_scr_ctx->render_buf, (font_width * font_height));
+        _disp_cells_paint(aline, col, 1);
     }
     else {
-        _scr_ctx->dirty_text_lines[aline] = true;
+        _dirty_cells_mark(aline, col, 1);
     }
 }
 
@@ -152,10 +118,12 @@ static void _disp_eol_clear(uint16_t aline, uint16_t col, paint_control_t paint)
     memset((_scr_ctx->full_screen_text + (aline * _scr_ctx->cols) + col), SPACE_CHR, (_scr_ctx->cols - col));
     memset((_scr_ctx->full_screen_color + (aline * _scr_ctx->cols) + col), colorbyte(_scr_ctx->color_fg_default, _scr_ctx->color_bg_default), (_scr_ctx->cols - col));
     if (paint) {
-        _disp_line_paint(aline);
+        if (col < _scr_ctx->cols) {
+            _disp_cells_paint(aline, col, _scr_ctx->cols - col);
+        }
     }
     else {
-        _scr_ctx->dirty_text_lines[aline] = true;
+        _dirty_cells_mark(aline, col, _scr_ctx->cols - col);
     }
 }
 
@@ -171,64 +139,136 @@ static void _disp_line_clear(uint16_t aline, paint_control_t paint) {
         _disp_line_paint(aline);
     }
     else {
-        _scr_ctx->dirty_text_lines[aline] = true;
+        _dirty_cells_mark(aline, 0, _scr_ctx->cols);
     }
 }
 
 /*
- * Update the portion of the screen containing the given character line.
+ * Render a strip of glyph (pixel) rows of a run of characters on a line into a buffer.
  *
- * Getting the glyph data for the font character is similar to `disp_char_colorbyte`,
- * but the difference is that here we are rendering a complete line of characters one
- * glyph line at a time, and repeating that for all of the glyph lines.
+ * The glyph rows are expanded with the pixel pair table (see glyph_render.h), using the
+ * interpolators if `DISP_GLYPH_INTERP` is set, and the cursor (if it is in the run) is drawn
+ * over its cell afterwards.
  *
  * NOTE: This does not perform text line translation, nor bounds check.
  */
-static void _disp_line_paint(uint16_t aline) {
+static void _disp_strip_render(rgb16_t* rbuf, uint16_t aline, uint16_t col, uint16_t ncols, int row, int nrows) {
+    const font_info_t* fi = _scr_ctx->font_info;
+    int8_t font_width = fi->width;
+    uint16_t w = ncols * font_width;
+    uint16_t index = (aline * _scr_ctx->cols) + col;
+    const uint8_t* text = &_scr_ctx->full_screen_text[index];
+    const colorbyte_t* colors = &_scr_ctx->full_screen_color[index];
+    int cursor_x = -1; // Pixel offset of the cursor cell in the run (-1 if it isn't in it)
+    uint16_t cursor_col = _scr_ctx->cursor_pos.column;
+    if (_scr_ctx->show_cursor && cursor_col >= col && cursor_col < col + ncols
+        && aline == _translate_cursor_line(_scr_ctx->cursor_pos.line)) {
+        cursor_x = (cursor_col - col) * font_width;
+    }
+    for (int glyph_line = row; glyph_line < row + nrows; glyph_line++) {
+#if DISP_GLYPH_INTERP
+        glyph_row_render_interp(rbuf, fi, text, colors, ncols, glyph_line, _glyph_lut);
+#else
+        glyph_row_render(rbuf, fi, text, colors, ncols, glyph_line, _glyph_lut);
+#endif
+        if (cursor_x >= 0 && glyph_line == fi->suggested_cursor_line) {
+            // Draw a cursor line
+            _fill_rgb16_buf(rbuf + cursor_x, _scr_ctx->cursor_color, font_width);
+        }
+        rbuf += w;
+    }
+}
+
+/*
+ * Update the portion of the screen containing a run of characters on a line.
+ *
+ * The characters are rendered a strip of pixel rows at a time, into the two strip buffers
+ * in turn, with as many rows in a strip as fit in a buffer (a buffer holds `DISP_STRIP_ROWS`
+ * rows of a full line, so a short run goes out in one strip). The strips are one display
+ * operation. Each strip is sent by DMA while the next one is rendered. This returns while
+ * the last strip is being sent (the next display operation waits for it).
+ *
+ * NOTE: This does not perform text line translation, nor bounds check.
+ */
+static void _disp_cells_paint(uint16_t aline, uint16_t col, uint16_t ncols) {
     const font_info_t* fi = _scr_ctx->font_info;
     int8_t font_height = fi->height;
     int8_t font_width = fi->width;
-    int8_t bpgl = fi->bytes_per_glyph_line;
-    bool show_cursor = (_scr_ctx->show_cursor && aline == _translate_cursor_line(_scr_ctx->cursor_pos.line));
-    int8_t cursor_show_row = fi->suggested_cursor_line;
-    uint16_t screen_line = aline * font_height;
-    rgb16_t* rbuf = _scr_ctx->render_buf;
-    for (int glyph_line = 0; glyph_line < font_height; glyph_line++) {
-        for (uint16_t textcol = 0; textcol < _scr_ctx->cols; textcol++) {
-            uint16_t index = (aline * _scr_ctx->cols) + textcol;
-            unsigned char c = _scr_ctx->full_screen_text[index];
-            bool invert = c & DISP_CHAR_INVERT_BIT;
-            unsigned char cl = c & 0x7F;
-            uint8_t color = _scr_ctx->full_screen_color[index];
-            uint8_t fg = (invert ? bg_from_cb(color) : fg_from_cb(color));
-            uint8_t bg = (invert ? fg_from_cb(color) : bg_from_cb(color));
-            rgb16_t fgrgb = rgb16_from_color16(fg);
-            rgb16_t bgrgb = rgb16_from_color16(bg);
-            // Get the glyph row for the character (a line of the font char height).
-            uint16_t glyphindex = (cl * font_height * bpgl);
-            uint32_t cgr = 0;
-            for (int byte = 0; byte < bpgl; byte++) {
-                cgr |= (fi->glyphs[glyphindex + byte + (glyph_line * bpgl)]) << (8u * byte);
-            }
-            for (uint32_t mask = (1u << (font_width - 1u)); mask; mask >>= 1u) {
-                if (show_cursor && textcol == _scr_ctx->cursor_pos.column && glyph_line == cursor_show_row) {
-                    // Draw a cursor line
-                    *rbuf++ = _scr_ctx->cursor_color;
-                }
-                else if (cgr & mask) {
-                    // set the fg color
-                    *rbuf++ = fgrgb;
-                }
-                else {
-                    // set the bg color
-                    *rbuf++ = bgrgb;
-                }
-            }
+    uint16_t w = ncols * font_width;
+    int rows = (_scr_ctx->cols * DISP_STRIP_ROWS) / ncols;
+    if (rows > font_height) {
+        rows = font_height;
+    }
+    // Set a window into the right part of the screen (this waits for a paint that is still
+    // sending, so both strip buffers are free)
+    ili_window_paint_begin(col * font_width, aline * font_height, w, font_height);
+    int strip = 0;
+    for (int row = 0; row < font_height; row += rows, strip ^= 1) {
+        int nrows = (font_height - row < rows ? font_height - row : rows);
+        rgb16_t* buf = _scr_ctx->strip_buf[strip];
+        _disp_strip_render(buf, aline, col, ncols, row, nrows);
+        // This waits for the previous strip (in the other buffer) to be sent
+        ili_window_paint_strip(buf, w * nrows, (row + nrows >= font_height));
+    }
+}
+
+/*
+ * Update the portion of the screen containing the given character line.
+ *
+ * NOTE: This does not perform text line translation, nor bounds check.
+ */
+static void _disp_line_paint(uint16_t aline) {
+    _disp_cells_paint(aline, 0, _scr_ctx->cols);
+}
+
+/*
+ * Mark a run of characters on a line as modified since paint (`disp_paint` paints them).
+ *
+ * NOTE: This does not perform text line translation, nor bounds check.
+ */
+static void _dirty_cells_mark(uint16_t aline, uint16_t col, uint16_t ncols) {
+    uint32_t* bits = &_scr_ctx->dirty_cells[aline * _scr_ctx->dirty_line_words];
+    for (uint16_t c = col; c < col + ncols; c++) {
+        bits[c >> 5] |= (1u << (c & 31));
+    }
+}
+
+/*
+ * Paint the modified characters of a line, and mark them 'not dirty'.
+ *
+ * Each run of adjacent modified characters is painted as one window, so changing a
+ * character only sends the pixels of its cell.
+ *
+ * NOTE: This does not perform text line translation, nor bounds check.
+ */
+static void _dirty_cells_paint(uint16_t aline) {
+    uint16_t words = _scr_ctx->dirty_line_words;
+    uint32_t* bits = &_scr_ctx->dirty_cells[aline * words];
+    uint16_t cols = _scr_ctx->cols;
+    uint16_t col = 0;
+    while (col < cols) {
+        if (0 == bits[col >> 5]) {
+            col = (col | 31) + 1; // Nothing modified in this word
+            continue;
+        }
+        if (!(bits[col >> 5] & (1u << (col & 31)))) {
+            col++;
+            continue;
         }
+        uint16_t start = col;
+        while (col < cols && (bits[col >> 5] & (1u << (col & 31)))) {
+            col++;
+        }
+        _disp_cells_paint(aline, start, col - start);
     }
-    // Write the pixel screen row to the display
-    ili_window_set_area(0, screen_line, _scr_ctx->cols * font_width, font_height);
-    ili_screen_paint(_scr_ctx->render_buf, _scr_ctx->cols * font_width * font_height);
+    memset(bits, 0, words * sizeof(uint32_t));
+}
+
+/*
+ * Mark the cell the cursor is in as modified (for the cursor being shown, hidden, or moved).
+ */
+static void _dirty_cursor_mark(void) {
+    _dirty_cells_mark(_translate_cursor_line(_scr_ctx->cursor_pos.line), _scr_ctx->cursor_pos.column, 1);
 }
 
 /*! @brief Fill an RGB-16 buffer with an RGB-16 value. */
@@ -287,7 +327,10 @@ void disp_cursor_home(void) {
 }
 
 void disp_cursor_show(bool show) {
-    _scr_ctx->show_cursor = show;
+    if (show != _scr_ctx->show_cursor) {
+        _scr_ctx->show_cursor = show;
+        _dirty_cursor_mark();
+    }
 }
 
 void disp_cursor_set(uint16_t line, uint16_t col) {
@@ -298,7 +341,13 @@ void disp_cursor_set_sp(scr_position_t pos) {
     if (pos.line >= _scr_ctx->scroll_size || pos.column >= _scr_ctx->cols) {
         return;
     }
+    if (_scr_ctx->show_cursor) {
+        _dirty_cursor_mark(); // (where it was)
+    }
     _scr_ctx->cursor_pos = pos;
+    if (_scr_ctx->show_cursor) {
+        _dirty_cursor_mark();
+    }
 }
 
 /*! @brief Create 'color-byte number' from forground & background color numbers */
@@ -340,7 +389,7 @@ void disp_clear(paint_control_t paint) {
     size_t chars = _scr_ctx->lines * _scr_ctx->cols;
     memset(_scr_ctx->full_screen_text, SPACE_CHR, chars);
     memset(_scr_ctx->full_screen_color, colorbyte(_scr_ctx->color_fg_default, _scr_ctx->color_bg_default), chars);
-    memset(_scr_ctx->dirty_text_lines, false, _scr_ctx->lines);
+    memset(_scr_ctx->dirty_cells, 0, _scr_ctx->lines * _scr_ctx->dirty_line_words * sizeof(uint32_t));
     disp_cursor_home();
     if (paint) {
         display_backlight_on(false);    // Turning off the backlight helps this from being distracting
@@ -425,6 +474,7 @@ void disp_module_init(void) {
 
     ili_module_init();
     ili_disp_info_t* disp_info = ili_info();
+    glyph_lut_build(_glyph_lut, _color16_map);
 
     // If in debug mode, print info about the display...
     if (debug_enabled()) {
@@ -482,19 +532,8 @@ void disp_line_paint(uint16_t line) {
  */
 void disp_paint(void) {
     int16_t lines = _scr_ctx->lines;
-    uint16_t aline;
-    bool some_lines_dirty = false;
-    for (uint16_t i = 0; i < lines && !some_lines_dirty; i++) {
-        some_lines_dirty |= _scr_ctx->dirty_text_lines[i];
-    }
-    if (some_lines_dirty) {
-        for (uint16_t line = 0; line < lines; line++) {
-            aline = _translate_line(line);
-            if (_scr_ctx->dirty_text_lines[aline]) {
-                _disp_line_paint(aline);
-                _scr_ctx->dirty_text_lines[aline] = false; // The text line has been painted, mark it 'not dirty'
-            }
-        }
+    for (uint16_t line = 0; line < lines; line++) {
+        _dirty_cells_paint(_translate_line(line));
     }
 }
 
@@ -506,6 +545,9 @@ void disp_print_crlf(int16_t add_lines, paint_control_t paint) {
     uint16_t cursor_cap = scroll_lines - 1;
     scr_position_t new_cp = { _scr_ctx->cursor_pos.line + 1, 0 };
     uint16_t aline;
+    if (_scr_ctx->show_cursor) {
+        _dirty_cursor_mark(); // (where it was, before the scroll start changes)
+    }
     if (new_cp.line > cursor_cap) {
         total_scroll_lines += (new_cp.line - cursor_cap);
         new_cp.line = cursor_cap;
@@ -625,6 +667,9 @@ void disp_printc(char c, paint_control_t paint) {
         }
     }
     _disp_char(aline, _scr_ctx->cursor_pos.column++, c, paint);
+    if (_scr_ctx->show_cursor && _scr_ctx->cursor_pos.column < _scr_ctx->cols) {
+        _dirty_cursor_mark();
+    }
 }
 
 void disp_prints(char* str, paint_control_t paint) {
@@ -704,8 +749,9 @@ void disp_text_colors_set(colorn16_t fg, colorn16_t bg) {
 }
 
 void disp_update(paint_control_t paint) {
-    // Mark all lines as 'dirty' so they will be re-rendered during a `paint` operation.
-    memset(_scr_ctx->dirty_text_lines, true, _scr_ctx->lines * sizeof(bool));
+    // Mark all cells as 'dirty' so they will be re-rendered during a `paint` operation.
+    // (the bits past the last column are ignored)
+    memset(_scr_ctx->dirty_cells, 0xff, _scr_ctx->lines * _scr_ctx->dirty_line_words * sizeof(uint32_t));
     if (paint) {
         disp_paint();
     }
@@ -719,8 +765,10 @@ void disp_screen_close() {
     // Free the buffers from the current context...
     free(_scr_ctx->full_screen_text);
     free(_scr_ctx->full_screen_color);
-    free(_scr_ctx->dirty_text_lines);
-    free(_scr_ctx->render_buf);
+    free(_scr_ctx->dirty_cells);
+    ili_paint_wait(); // (a strip buffer could still be being sent)
+    free(_scr_ctx->strip_buf[0]);
+    free(_scr_ctx->strip_buf[1]);
     // Now free the current context
     free(_scr_ctx);
 
@@ -762,8 +810,10 @@ screen_ctx_t* disp_screen_new() {
     // Allocate buffers
     scr_context->full_screen_text = (uint8_t*)malloc(chars);
     scr_context->full_screen_color = (colorbyte_t*)malloc(chars);
-    scr_context->dirty_text_lines = (bool*)calloc(lines, sizeof(bool));
-    scr_context->render_buf = (rgb16_t*)malloc(fi->width * fi->height * cols * sizeof(rgb16_t));
+    scr_context->dirty_line_words = (cols + 31) / 32;
+    scr_context->dirty_cells = (uint32_t*)calloc(lines * scr_context->dirty_line_words, sizeof(uint32_t));
+    scr_context->strip_buf[0] = (rgb16_t*)malloc(fi->width * DISP_STRIP_ROWS * cols * sizeof(rgb16_t));
+    scr_context->strip_buf[1] = (rgb16_t*)malloc(fi->width * DISP_STRIP_ROWS * cols * sizeof(rgb16_t));
     // Default scroll area to the full screen
     scr_context->fixed_area_top_size = 0;
     scr_context->fixed_area_bottom_size = 0;
@@ -0,0 +1,161 @@
+/**
+ * Glyph rendering (rasterizing text into RGB-16 pixels).
+ *
+ * See the glyph_render.h header for important information.
+ *
+ * Copyright 2023 AESilky
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "glyph_render.h"
+
+#include "hardware/interp.h"
+
+/**
+ * @brief The color-byte to use for a character (the colors swapped if it is inverse).
+ */
+static inline colorbyte_t _cb_for(uint8_t c, colorbyte_t cb) {
+    return ((c & DISP_CHAR_INVERT_BIT) ? (colorbyte_t)((cb << 4) | (cb >> 4)) : cb);
+}
+
+/**
+ * @brief Get the bits of a glyph row (the leftmost pixel is bit `width - 1`).
+ */
+static inline uint32_t _glyph_row(const font_info_t* fi, uint8_t c, int glyph_line) {
+    int8_t bpgl = fi->bytes_per_glyph_line;
+    const uint8_t* g = &fi->glyphs[(((c & DISP_CHAR_NORMAL_MASK) * fi->height) + glyph_line) * bpgl];
+    uint32_t cgr = g[0];
+    for (int byte = 1; byte < bpgl; byte++) {
+        cgr |= ((uint32_t)g[byte]) << (8u * byte);
+    }
+    return (cgr);
+}
+
+void glyph_lut_build(glyph_lut_t lut, const rgb16_t* palette) {
+    for (int cb = 0; cb < 256; cb++) {
+        uint32_t fg = palette[cb & 0x0f];
+        uint32_t bg = palette[cb >> 4];
+        lut[cb][0] = (bg << 16) | bg;
+        lut[cb][1] = (fg << 16) | bg;   // (the right pixel is set)
+        lut[cb][2] = (bg << 16) | fg;   // (the left pixel is set)
+        lut[cb][3] = (fg << 16) | fg;
+    }
+}
+
+void glyph_row_render(rgb16_t* dst, const font_info_t* fi, const uint8_t* text, const colorbyte_t* colors,
+    uint16_t ncols, int glyph_line, const glyph_lut_t lut) {
+    int8_t font_width = fi->width;
+    if (font_width & 1) {
+        // The pixels of a cell aren't whole words. Use the table for the colors only.
+        for (uint16_t n = 0; n < ncols; n++) {
+            const uint32_t* pairs = lut[_cb_for(text[n], colors[n])];
+            rgb16_t fg = (rgb16_t)pairs[3];
+            rgb16_t bg = (rgb16_t)pairs[0];
+            uint32_t cgr = _glyph_row(fi, text[n], glyph_line);
+            for (uint32_t mask = (1u << (font_width - 1u)); mask; mask >>= 1u) {
+                *dst++ = ((cgr & mask) ? fg : bg);
+            }
+        }
+        return;
+    }
+    uint32_t* out = (uint32_t*)dst;
+    if (10 == font_width) {
+        // The font in use, unrolled
+        for (uint16_t n = 0; n < ncols; n++) {
+            const uint32_t* pairs = lut[_cb_for(text[n], colors[n])];
+            uint32_t cgr = _glyph_row(fi, text[n], glyph_line);
+            out[0] = pairs[(cgr >> 8) & 3];
+            out[1] = pairs[(cgr >> 6) & 3];
+            out[2] = pairs[(cgr >> 4) & 3];
+            out[3] = pairs[(cgr >> 2) & 3];
+            out[4] = pairs[cgr & 3];
+            out += 5;
+        }
+        return;
+    }
+    for (uint16_t n = 0; n < ncols; n++) {
+        const uint32_t* pairs = lut[_cb_for(text[n], colors[n])];
+        uint32_t cgr = _glyph_row(fi, text[n], glyph_line);
+        for (int shift = font_width - 2; shift >= 0; shift -= 2) {
+            *out++ = pairs[(cgr >> shift) & 3];
+        }
+    }
+}
+
+/**
+ * @brief Set the lanes of an interpolator to take two pixel pairs from ACCUM0.
+ *
+ * ACCUM0 is the glyph row times 4 (the size of a table entry), so the two bits shifted down
+ * to bits 2-3 are the byte offset of the pair in the color-byte's entries (BASE). Lane 1 uses
+ * ACCUM0 as well (CROSS_INPUT), so a cell is one accumulator write for both lanes.
+ */
+static void _interp_lanes_config(interp_hw_t* interp, uint shift0, uint shift1) {
+    interp_config cfg = interp_default_config();
+    interp_config_set_shift(&cfg, shift0);
+    interp_config_set_mask(&cfg, 2, 3);
+    interp_set_config(interp, 0, &cfg);
+    interp_config_set_shift(&cfg, shift1);
+    interp_config_set_cross_input(&cfg, true);
+    interp_set_config(interp, 1, &cfg);
+}
+
+void glyph_row_render_interp(rgb16_t* dst, const font_info_t* fi, const uint8_t* text, const colorbyte_t* colors,
+    uint16_t ncols, int glyph_line, const glyph_lut_t lut) {
+    int8_t font_width = fi->width;
+    if ((font_width & 1) || font_width < 8) {
+        glyph_row_render(dst, fi, text, colors, ncols, glyph_line, lut);
+        return;
+    }
+    // The four leftmost pixel pairs come from the lanes, the rest (if any) from the table
+    _interp_lanes_config(interp0, font_width - 2, font_width - 4);
+    _interp_lanes_config(interp1, font_width - 6, font_width - 8);
+    uint32_t* out = (uint32_t*)dst;
+    for (uint16_t n = 0; n < ncols; n++) {
+        const uint32_t* pairs = lut[_cb_for(text[n], colors[n])];
+        uint32_t cgr = _glyph_row(fi, text[n], glyph_line);
+        interp_set_base(interp0, 0, (uintptr_t)pairs);
+        interp_set_base(interp0, 1, (uintptr_t)pairs);
+        interp_set_base(interp1, 0, (uintptr_t)pairs);
+        interp_set_base(interp1, 1, (uintptr_t)pairs);
+        interp_set_accumulator(interp0, 0, cgr << 2);
+        interp_set_accumulator(interp1, 0, cgr << 2);
+        out[0] = *(const uint32_t*)(uintptr_t)interp_peek_lane_result(interp0, 0);
+        out[1] = *(const uint32_t*)(uintptr_t)interp_peek_lane_result(interp0, 1);
+        out[2] = *(const uint32_t*)(uintptr_t)interp_peek_lane_result(interp1, 0);
+        out[3] = *(const uint32_t*)(uintptr_t)interp_peek_lane_result(interp1, 1);
+        out += 4;
+        for (int shift = font_width - 10; shift >= 0; shift -= 2) {
+            *out++ = pairs[(cgr >> shift) & 3];
+        }
+    }
+}
+
+void glyph_row_render_ref(rgb16_t* dst, const font_info_t* fi, const uint8_t* text, const colorbyte_t* colors,
+    uint16_t ncols, int glyph_line, const rgb16_t* palette) {
+    int8_t font_height = fi->height;
+    int8_t font_width = fi->width;
+    int8_t bpgl = fi->bytes_per_glyph_line;
+    for (uint16_t n = 0; n < ncols; n++) {
+        unsigned char c = text[n];
+        bool invert = c & DISP_CHAR_INVERT_BIT;
+        unsigned char cl = c & 0x7F;
+        uint8_t color = colors[n];
+        uint8_t fg = (invert ? (color >> 4) : (color & 0x0f));
+        uint8_t bg = (invert ? (color & 0x0f) : (color >> 4));
+        rgb16_t fgrgb = palette[fg];
+        rgb16_t bgrgb = palette[bg];
+        uint16_t glyphindex = (cl * font_height * bpgl);
+        uint32_t cgr = 0;
+        for (int byte = 0; byte < bpgl; byte++) {
+            cgr |= (fi->glyphs[glyphindex + byte + (glyph_line * bpgl)]) << (8u * byte);
+        }
+        for (uint32_t mask = (1u << (font_width - 1u)); mask; mask >>= 1u) {
+            if (cgr & mask) {
+                *dst++ = fgrgb;
+            }
+            else {
+                *dst++ = bgrgb;
+            }
+        }
+    }
+}
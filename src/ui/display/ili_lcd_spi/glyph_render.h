@@ -0,0 +1,93 @@
+/**
+ * @brief Glyph rendering (rasterizing text into RGB-16 pixels).
+ * @ingroup display
+ *
+ * Renders one glyph (pixel) row of a run of characters at a time.
+ *
+ * `glyph_row_render` uses a table for each color-byte of the pixel pairs that two glyph bits
+ * make, so each pair of pixels is a table load and a 32-bit store (no per-pixel test or color
+ * select). The table (`glyph_lut_t`) is 4KB and is built once for a palette.
+ *
+ * `glyph_row_render_interp` does the same with the core's interpolators (interp0 and interp1)
+ * doing the glyph bit extraction and the table indexing, so a pixel pair is a lane result read
+ * and a table load. It takes over the lane setup of both of the calling core's interpolators
+ * (nothing else uses them). The display uses it when it is built with `DISP_GLYPH_INTERP` set
+ * to 1. The host build has a functional model of the interpolators (see the host
+ * `hardware/interp.h`), so the host benchmark checks it too.
+ *
+ * `glyph_row_render_ref` is the plain per-pixel renderer. It is kept to check the table
+ * renderer against (and to measure it against) in the host benchmark (src/host/bench).
+ *
+ * Neither draws the cursor. The caller draws it over the cell's pixels.
+ *
+ * Copyright 2023 AESilky
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _GLYPH_RENDER_H_
+#define _GLYPH_RENDER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "display.h"
+#include "font.h"
+
+#include <stdint.h>
+
+/**
+ * @brief Pixel pairs for each color-byte and pair of glyph bits.
+ *
+ * `[cb][bits]` holds two RGB-16 pixels, the left one (the higher glyph bit) in the low half
+ * (the first in memory on the little-endian RP2040).
+ */
+typedef uint32_t glyph_lut_t[256][4];
+
+/**
+ * @brief Build the pixel pair table for a palette.
+ *
+ * @param lut The table to fill in.
+ * @param palette The RGB-16 value of each of the 16 color numbers.
+ */
+extern void glyph_lut_build(glyph_lut_t lut, const rgb16_t* palette);
+
+/**
+ * @brief Render a glyph row of a run of characters, using the pixel pair table.
+ *
+ * @param dst Buffer for `ncols * fi->width` pixels. For fonts with an even width, it must be
+ *            32-bit aligned.
+ * @param fi The font.
+ * @param text The characters (DISP_CHAR_INVERT_BIT set for inverse).
+ * @param colors The color-bytes of the characters.
+ * @param ncols The number of characters.
+ * @param glyph_line The glyph row (0 to `fi->height - 1`).
+ * @param lut The pixel pair table (`glyph_lut_build`).
+ */
+extern void glyph_row_render(rgb16_t* dst, const font_info_t* fi, const uint8_t* text, const colorbyte_t* colors,
+    uint16_t ncols, int glyph_line, const glyph_lut_t lut);
+
+/**
+ * @brief Render a glyph row of a run of characters, using the interpolators and the pixel
+ *        pair table.
+ *
+ * Fonts with an odd width, or narrower than 8, are rendered by `glyph_row_render`.
+ *
+ * @see glyph_row_render()
+ */
+extern void glyph_row_render_interp(rgb16_t* dst, const font_info_t* fi, const uint8_t* text, const colorbyte_t* colors,
+    uint16_t ncols, int glyph_line, const glyph_lut_t lut);
+
+/**
+ * @brief Render a glyph row of a run of characters, a pixel at a time.
+ *
+ * @see glyph_row_render()
+ *
+ * @param palette The RGB-16 value of each of the 16 color numbers.
+ */
+extern void glyph_row_render_ref(rgb16_t* dst, const font_info_t* fi, const uint8_t* text, const colorbyte_t* colors,
+    uint16_t ncols, int glyph_line, const rgb16_t* palette);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // _GLYPH_RENDER_H_
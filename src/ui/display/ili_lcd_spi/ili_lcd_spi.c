@@ -14,6 +14,8 @@
 #include "ili9341_spi/ili9341_spi.h"
 #include "ili9488_spi/ili9488_spi.h"
 #include "board.h"
+#include "cmt.h"
+#include "multicore.h"
 #include "spi_ops.h"
 
 #include "pico/stdlib.h"
@@ -40,6 +42,22 @@ static bool _screen_dirty = true; // start out assuming dirty
 static ili_disp_info_t _ili_disp_info;
 static ili_ctrl_type _ili_controller_type = ILI_CTRL_NONE;
 
+/**
+ * @brief What to do when an asynchronous (DMA) paint is done.
+ *
+ * It is passed to the DMA interrupt (as its user data). A paint can't start until the
+ * previous one has been finished, so there is one.
+ */
+typedef struct _paint_done_ {
+    bool post;                          // Post `msg` to `core`
+    uint8_t core;
+    cmt_msg_t msg;
+} _paint_done_t;
+
+static _paint_done_t _paint_done;
+static _paint_done_t _paint_done_late;            // A done message that couldn't be posted yet
+static volatile bool _paint_done_latched = false; // `_paint_done_late` is waiting to be posted
+
 /**
  * Set the chip select for the display.
  *
@@ -66,8 +84,30 @@ static void _command_mode(bool cmd) {
     }
 }
 
+/**
+ * @brief Post an asynchronous paint's done message.
+ *
+ * @return true if it was posted (or scheduled to be).
+ */
+static bool _paint_done_post(_paint_done_t* pd) {
+    if (0 == pd->core ? post_to_core0_nowait(&pd->msg) : post_to_core1_nowait(&pd->msg)) {
+        return (true);
+    }
+    // The core's queue is full. A scheduled message has a slot reserved for it.
+    return (schedule_core_msg_in_us((0 == pd->core ? CMT_SM_CORE0 : CMT_SM_CORE1), 0, &pd->msg) != CMT_SM_HANDLE_INVALID);
+}
+
+/** @brief Post a paint's done message that couldn't be posted when the paint finished. */
+static void _paint_done_retry(void) {
+    if (_paint_done_latched && !spi_dma_busy() && _paint_done_post(&_paint_done_late)) {
+        _paint_done_latched = false;
+    }
+}
+
+/** @brief Begin an operation. Waits for an asynchronous paint to finish. */
 static void _op_begin() {
     spi_display_begin();
+    _paint_done_retry();
     _cs(true);
 }
 
@@ -146,6 +186,22 @@ static void _write_area(const rgb16_t* rgb_pixel_data, uint16_t pixels) {
     spi_display_write16(rgb_pixel_data, pixels);
 }
 
+/**
+ * @brief An asynchronous paint has finished. Called from the DMA interrupt.
+ *
+ * Ends the operation and posts the paint's done message (if it has one) to the
+ * core that started the paint.
+*/
+static void _paint_async_done(void* user_data) {
+    _paint_done_t* pd = (_paint_done_t*)user_data;
+    _op_end();
+    if (pd->post && !_paint_done_post(pd)) {
+        // Keep it until it can be posted (by the next display operation or paint check)
+        _paint_done_late = *pd;
+        _paint_done_latched = true;
+    }
+}
+
 /**
  * Show all of the colors.
  */
@@ -301,6 +357,55 @@ void ili_screen_paint(const rgb16_t* rgb_pixel_data, uint16_t pixels) {
     _screen_dirty = true;
 }
 
+bool ili_screen_paint_async(const rgb16_t* rgb_pixel_data, uint32_t pixels, const cmt_msg_t* done_msg) {
+    _op_begin(); // (waits for the previous paint to be finished, so `_paint_done` is free)
+    if (done_msg && _paint_done_latched) {
+        // The last done message still hasn't been posted (there is room to keep one)
+        _op_end();
+        return (false);
+    }
+    _paint_done.post = (done_msg != NULL);
+    if (done_msg) {
+        _paint_done.msg = *done_msg;
+    }
+    _paint_done.core = (uint8_t)get_core_num();
+    _screen_dirty = true;
+    if (!spi_display_write16_dma(rgb_pixel_data, pixels, _paint_async_done, &_paint_done)) {
+        // The DMA is busy with the other SPI
+        _op_end();
+        return (false);
+    }
+    return (true);
+}
+
+void ili_window_paint_begin(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    _op_begin(); // (ended when the last strip has been sent)
+    _set_window(x, y, w, h);
+    _screen_dirty = true;
+}
+
+void ili_window_paint_strip(const rgb16_t* rgb_pixel_data, uint32_t pixels, bool last) {
+    spi_dma_wait(); // The previous strip has been sent (the operation stays open)
+    _paint_done.post = false;
+    if (!spi_display_write16_dma(rgb_pixel_data, pixels, (last ? _paint_async_done : NULL), &_paint_done)) {
+        // The DMA is busy with the other SPI
+        spi_display_write16(rgb_pixel_data, pixels);
+        if (last) {
+            _op_end();
+        }
+    }
+}
+
+bool ili_paint_busy(void) {
+    _paint_done_retry();
+    return (spi_dma_busy());
+}
+
+void ili_paint_wait(void) {
+    spi_dma_wait();
+    _paint_done_retry();
+}
+
 uint16_t ili_screen_width() {
     return _screen_width;
 }
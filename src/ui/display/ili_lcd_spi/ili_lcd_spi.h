@@ -13,6 +13,12 @@
 extern "C" {
 #endif
 
+#include "cmt.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 // 24-bit RGB Color to Basic 16 Colors (match original PC VGA system)
 //                                      NUM :   R    G    B
 //                                      --- : ---  ---  ---
@@ -279,6 +285,73 @@ extern void ili_screen_on(bool on);
  */
 extern void ili_screen_paint(const rgb16_t* rgb_pixel_data, uint16_t pixels);
 
+/**
+ * @brief Start painting the screen with the contents of a buffer, and return without waiting.
+ * @ingroup display
+ *
+ * The pixels are streamed to the display by DMA (as 16-bit SPI frames), so the core can
+ * do other work while they are sent. When the last pixel has been sent the done message
+ * (if one is given) is posted to the calling core's message loop, from the DMA interrupt.
+ * The buffer must not be changed until then. If the core's queue is full the message is
+ * scheduled to be posted (a scheduled message has a slot reserved for it), and if that
+ * can't be done it is kept and posted by the next display operation (or `ili_paint_busy`).
+ *
+ * The other display operations (including another paint) wait for the paint to finish
+ * before they start. Use `ili_paint_busy` to check if it is still running.
+ *
+ * @param rgb_pixel_data RGB-16 pixel data buffer (1 rgb value for each pixel to paint)
+ * @param pixels Number of pixels (size of the data buffer in rgb16_t's)
+ * @param done_msg Message to post when the paint is done (copied), or NULL for none.
+ * @return true if the paint was started. false if the DMA was busy with another SPI device,
+ *         or the last paint's done message is still waiting to be posted (the done message
+ *         won't be posted).
+ */
+extern bool ili_screen_paint_async(const rgb16_t* rgb_pixel_data, uint32_t pixels, const cmt_msg_t* done_msg);
+
+/**
+ * @brief Start painting a window of the screen in strips (one operation for all of them).
+ * @ingroup display
+ *
+ * Sets the window and keeps the display selected until the last strip has been sent, so
+ * the strips are one display operation. Send the pixels with `ili_window_paint_strip`.
+ * No other display operation can be used until the last strip has been started.
+ *
+ * @param x The left of the window.
+ * @param y The top of the window.
+ * @param w The width of the window.
+ * @param h The height of the window.
+ */
+extern void ili_window_paint_begin(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+/**
+ * @brief Send a strip of pixels of a window started with `ili_window_paint_begin`.
+ * @ingroup display
+ *
+ * Waits for the previous strip to be sent, starts sending this one by DMA, and returns. So,
+ * with two buffers, the next strip can be rendered while this one is sent. The buffer must
+ * not be changed until the next strip has been started (or, for the last one, until
+ * `ili_paint_busy` is false). The operation is ended when the last strip has been sent.
+ *
+ * @param rgb_pixel_data RGB-16 pixel data buffer (1 rgb value for each pixel to paint)
+ * @param pixels Number of pixels (size of the data buffer in rgb16_t's)
+ * @param last True for the last strip of the window.
+ */
+extern void ili_window_paint_strip(const rgb16_t* rgb_pixel_data, uint32_t pixels, bool last);
+
+/**
+ * @brief Check if an asynchronous paint is still running.
+ * @ingroup display
+ *
+ * @return true if it is running.
+ */
+extern bool ili_paint_busy(void);
+
+/**
+ * @brief Wait for an asynchronous paint to finish.
+ * @ingroup display
+ */
+extern void ili_paint_wait(void);
+
 /**
  * @brief The width of the display screen (pixel columns).
  * @ingroup display
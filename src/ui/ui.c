@@ -11,9 +11,11 @@
 #include "ui.h"
 
 #include "cmt.h"
+#include "cmt_trace.h"
 #include "core1_main.h"
 #include "display.h"
 #include "board.h"
+#include "msg_payload.h"
 #include "multicore.h"
 #include "util.h"
 #include "ui_disp.h"
@@ -43,7 +45,8 @@ static const msg_handler_entry_t _force_to_code_window_entry = { MSG_DISPLAY_MES
  * @brief List of handler entries.
  * @ingroup ui
  *
- * For performance, put these in the order that we expect to receive the most (most -> least).
+ * The loop dispatches by message ID, so the order only matters when there is more than one
+ * handler for a message (they are called in list order).
  *
  */
 static const msg_handler_entry_t* _handler_entries[] = {
@@ -52,15 +55,17 @@ static const msg_handler_entry_t* _handler_entries[] = {
     ((msg_handler_entry_t*)0), // Last entry must be a NULL
 };
 
-static const idle_fn _ui_idle_functions[] = {
-    (idle_fn)_ui_idle_function_1,
-    (idle_fn)0, // Last entry must be a NULL
+static const idle_task_entry_t _ui_idle_task_1 = { _ui_idle_function_1, (100 * 1000), 100 };
+
+static const idle_task_entry_t* _ui_idle_tasks[] = {
+    &_ui_idle_task_1,
+    ((idle_task_entry_t*)0), // Last entry must be a NULL
 };
 
 msg_loop_cntx_t ui_msg_loop_cntx = {
     UI_CORE_NUM, // UI runs on Core 1
     _handler_entries,
-    _ui_idle_functions,
+    _ui_idle_tasks,
 };
 
 // ============================================
@@ -95,12 +100,14 @@ static void _handle_be_initialized(cmt_msg_t* msg) {
  * the backend or an interrupt handler (non-UI) process wants to be displayed
  * (for example, status, warning, etc).
  *
- * @param msg The data contains a string that needs to be freed once handled.
+ * @param msg The payload contains the string (see `cmt_msg_payload_str`). The payload is released
+ *            by the message loop once handled.
  */
 static void _handle_window_output(cmt_msg_t* msg) {
-    char* str = msg->data.str;
-    disp_prints(str, Paint);
-    free(str);
+    char* str = cmt_msg_payload(msg);
+    if (str) {
+        disp_prints(str, Paint);
+    }
 }
 
 
@@ -109,6 +116,7 @@ static void _handle_window_output(cmt_msg_t* msg) {
 // ============================================
 
 void _ui_gpio_irq_handler(uint gpio, uint32_t events) {
+    cmt_trace(CMT_TRACE_ISR_ENTER, (uint8_t)gpio, CMT_TRACE_ISR_B(CMT_TRACE_ISR_SRC_GPIO, events));
     switch (gpio) {
         case IRQ_rotary_SW:
             //re_pbsw_irq_handler(gpio, events);
@@ -117,6 +125,7 @@ void _ui_gpio_irq_handler(uint gpio, uint32_t events) {
             //re_turn_irq_handler(gpio, events);
             break;
     }
+    cmt_trace(CMT_TRACE_ISR_EXIT, (uint8_t)gpio, CMT_TRACE_ISR_B(CMT_TRACE_ISR_SRC_GPIO, events));
 }
 
 